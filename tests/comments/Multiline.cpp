@@ -134,3 +134,23 @@ R"(
     std::string actual = Reflow(input, style);
     REQUIRE(actual == expected);
 }
+
+TEST_CASE("Non ASCII Widths") {
+    // Each é is two bytes, but is shown in one column, so lines are measured in code points
+    Style style;
+
+    SECTION("Line That Only Looks Long In Bytes") {
+        std::string input = "\n/* \xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\n * next */\n";
+        std::string expected = "\n/* \xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\n * next\n */\n";
+        style.targetLineLength = 25;
+
+        REQUIRE(Reflow(input, style) == expected);
+    }
+
+    SECTION("Comment After Non ASCII Code") {
+        std::string input = "\nauto s = \"\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\"; /* aaa bb */\n";
+        style.targetLineLength = 30;
+
+        REQUIRE(Reflow(input, style) == input);
+    }
+}
@@ -0,0 +1,81 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <tree-sitter-format/document/AddBuffer.h>
+
+#include <string>
+#include <vector>
+
+using namespace tree_sitter_format;
+using namespace std::literals::string_view_literals;
+
+TEST_CASE("Append") {
+    AddBuffer buffer;
+
+    SECTION("Copies Bytes") {
+        std::string source = "int a;";
+        std::string_view added = buffer.append(source);
+        source[0] = 'x';
+
+        REQUIRE(added == "int a;");
+        REQUIRE(added.data() != source.data());
+    }
+
+    SECTION("Repeated") {
+        REQUIRE(buffer.appendRepeated(' ', 4) == "    ");
+        REQUIRE(buffer.appendRepeated('\t', 2) == "\t\t");
+    }
+
+    SECTION("Empty") {
+        REQUIRE(buffer.append(""sv).empty());
+        REQUIRE(buffer.appendRepeated(' ', 0).empty());
+    }
+}
+
+TEST_CASE("Views Stay Valid") {
+    AddBuffer buffer;
+    std::vector<std::string_view> views;
+    std::vector<std::string> expected;
+
+    // Enough appends to fill several blocks, plus one bigger than a block.
+    for(uint32_t i = 0; i < 5000; i++) {
+        expected.push_back(std::to_string(i) + ";");
+        views.push_back(buffer.append(expected.back()));
+    }
+    expected.push_back(std::string(100000, 'a'));
+    views.push_back(buffer.append(expected.back()));
+
+    AddBuffer moved = std::move(buffer);
+    views.push_back(moved.append("after move"sv));
+    expected.push_back("after move");
+
+    for(size_t i = 0; i < views.size(); i++) {
+        REQUIRE(views[i] == expected[i]);
+    }
+}
+
+TEST_CASE("Adopt") {
+    AddBuffer buffer;
+    std::string_view before = buffer.append("int a;"sv);
+
+    AddBuffer other;
+    std::string_view adopted = other.append("int b;"sv);
+    std::string_view large = other.append(std::string(100000, 'b'));
+
+    buffer.adopt(std::move(other));
+    std::string_view after = buffer.append("int c;"sv);
+
+    REQUIRE(before == "int a;");
+    REQUIRE(adopted == "int b;");
+    REQUIRE(large == std::string(100000, 'b'));
+    REQUIRE(after == "int c;");
+
+    // Appends carry on in the block that was being filled
+    REQUIRE(after.data() == before.data() + before.size());
+
+    size_t blocks = 0;
+    buffer.forEachBlock([&](const char*, size_t) { blocks++; });
+    REQUIRE(blocks == 3);
+
+    other.forEachBlock([&](const char*, size_t) { blocks++; });
+    REQUIRE(blocks == 3);
+}
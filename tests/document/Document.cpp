@@ -0,0 +1,653 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <tree-sitter-format/document/Document.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace tree_sitter_format;
+using namespace std::literals::string_view_literals;
+
+TEST_CASE("Apply Edits") {
+    Document document(std::string("int a;\n    int b;\nint c; \n"));
+    document.collectParseStatistics();
+
+    auto between = [&](uint32_t start, uint32_t end) {
+        return Range::Between(document.positionAt(start), document.positionAt(end));
+    };
+
+    SECTION("Unchanged Replacement") {
+        document.applyEdits({
+            DeleteEdit {.range = between(7, 11)},
+            InsertEdit {.position = document.positionAt(7), .bytes = "    "sv},
+        });
+
+        REQUIRE(document.toString() == "int a;\n    int b;\nint c; \n");
+        REQUIRE(document.parseStatistics().value().reparses == 0);
+    }
+
+    SECTION("Empty Edits") {
+        document.applyEdits({
+            DeleteEdit {.range = between(24, 24)},
+            InsertEdit {.position = document.positionAt(3), .bytes = ""sv},
+        });
+
+        REQUIRE(document.parseStatistics().value().reparses == 0);
+    }
+
+    SECTION("Partly Changed Replacement") {
+        document.applyEdits({
+            DeleteEdit {.range = between(7, 11)},
+            InsertEdit {.position = document.positionAt(11), .bytes = "  "sv},
+        });
+
+        REQUIRE(document.toString() == "int a;\n  int b;\nint c; \n");
+        REQUIRE(document.parseStatistics().value().reparses == 0);
+        REQUIRE(document.parseStatistics().value().shifts == 1);
+        REQUIRE(ts_node_start_byte(ts_node_child(document.root(), 1)) == 9);
+    }
+
+    SECTION("Touching Edits") {
+        document.applyEdits({
+            DeleteEdit {.range = between(24, 25)},
+            InsertEdit {.position = document.positionAt(25), .bytes = " "sv},
+            DeleteEdit {.range = between(25, 26)},
+        });
+
+        REQUIRE(document.toString() == "int a;\n    int b;\nint c; ");
+    }
+
+    SECTION("Whitespace Only Edits") {
+        document.applyEdits({
+            InsertEdit {.position = document.positionAt(7), .bytes = "\n"sv},
+            InsertEdit {.position = document.positionAt(18), .bytes = "  "sv},
+        });
+
+        REQUIRE(document.toString() == "int a;\n\n    int b;\n  int c; \n");
+        REQUIRE(document.parseStatistics().value().reparses == 0);
+        REQUIRE(document.parseStatistics().value().shifts == 1);
+
+        TSNode b = ts_node_child(document.root(), 1);
+        REQUIRE(ts_node_start_byte(b) == 12);
+        REQUIRE(ts_node_start_point(b).row == 2);
+        REQUIRE(ts_node_start_point(b).column == 4);
+
+        TSNode c = ts_node_child(document.root(), 2);
+        REQUIRE(ts_node_start_byte(c) == 21);
+        REQUIRE(ts_node_start_point(c).row == 3);
+        REQUIRE(ts_node_start_point(c).column == 2);
+    }
+
+    SECTION("Edits That Change Tokens") {
+        SECTION("Emptied Gap") {
+            document.applyEdits({
+                DeleteEdit {.range = between(3, 4)},
+            });
+
+            REQUIRE(document.toString() == "inta;\n    int b;\nint c; \n");
+        }
+
+        SECTION("Filled Gap") {
+            document.applyEdits({
+                InsertEdit {.position = document.positionAt(5), .bytes = " "sv},
+            });
+
+            REQUIRE(document.toString() == "int a ;\n    int b;\nint c; \n");
+        }
+
+        SECTION("Removed Only New Line") {
+            document.applyEdits({
+                DeleteEdit {.range = between(6, 11)},
+                InsertEdit {.position = document.positionAt(6), .bytes = " "sv},
+            });
+
+            REQUIRE(document.toString() == "int a; int b;\nint c; \n");
+        }
+
+        REQUIRE(document.parseStatistics().value().reparses == 1);
+        REQUIRE(document.parseStatistics().value().shifts == 0);
+    }
+
+    SECTION("Duplicate Deletes") {
+        document.applyEdits({
+            DeleteEdit {.range = between(24, 25)},
+            DeleteEdit {.range = between(24, 25)},
+        });
+
+        REQUIRE(document.toString() == "int a;\n    int b;\nint c;\n");
+        REQUIRE(document.lineCount() == 4);
+    }
+}
+
+bool SamePoint(TSPoint left, TSPoint right) {
+    return left.row == right.row && left.column == right.column;
+}
+
+// Whether the trees have the same nodes in the same places
+bool SameTree(TSNode left, TSNode right) {
+    if (ts_node_symbol(left) != ts_node_symbol(right) ||
+        ts_node_start_byte(left) != ts_node_start_byte(right) || ts_node_end_byte(left) != ts_node_end_byte(right) ||
+        !SamePoint(ts_node_start_point(left), ts_node_start_point(right)) || !SamePoint(ts_node_end_point(left), ts_node_end_point(right)) ||
+        ts_node_child_count(left) != ts_node_child_count(right)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < ts_node_child_count(left); i++) {
+        if (!SameTree(ts_node_child(left, i), ts_node_child(right, i))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+TEST_CASE("Moved Trees Match A Fresh Parse") {
+    std::string contents;
+    std::vector<Edit> edits;
+    uint32_t shifts = 0;
+
+    SECTION("Insert After A Token") {
+        contents = "int a;\nint b;\n";
+        edits = {InsertEdit {.position = Position {.location = {0, 6}, .byteOffset = 6}, .bytes = "  "sv}};
+    }
+
+    SECTION("Delete After A Token") {
+        contents = "int a;  \nint b;\n";
+        edits = {DeleteEdit {.range = Range::Between(Position {.location = {0, 6}, .byteOffset = 6}, Position {.location = {0, 8}, .byteOffset = 8})}};
+        shifts = 1;
+    }
+
+    SECTION("Insert Before A Token") {
+        contents = "int a;\nint b;\n";
+        edits = {InsertEdit {.position = Position {.location = {1, 0}, .byteOffset = 7}, .bytes = "  "sv}};
+        shifts = 1;
+    }
+
+    SECTION("Whitespace In A String") {
+        contents = "const char* s = \"  \";\n";
+        edits = {DeleteEdit {.range = Range::Between(Position {.location = {0, 17}, .byteOffset = 17}, Position {.location = {0, 18}, .byteOffset = 18})}};
+    }
+
+    SECTION("Whitespace In A Character") {
+        contents = "char c = ' ';\n";
+        edits = {InsertEdit {.position = Position {.location = {0, 11}, .byteOffset = 11}, .bytes = " "sv}};
+    }
+
+    SECTION("After A Line Comment") {
+        contents = "int a; // x\nint b;\n";
+        edits = {InsertEdit {.position = Position {.location = {0, 11}, .byteOffset = 11}, .bytes = "  "sv}};
+    }
+
+    SECTION("After A Line Continuation") {
+        contents = "int a = \\\n  1;\n";
+        edits = {DeleteEdit {.range = Range::Between(Position {.location = {1, 0}, .byteOffset = 10}, Position {.location = {1, 1}, .byteOffset = 11})}};
+    }
+
+    SECTION("After A Directive") {
+        contents = "#if X\nint a;\n#endif\n";
+        edits = {InsertEdit {.position = Position {.location = {1, 0}, .byteOffset = 6}, .bytes = "  "sv}};
+    }
+
+    Document document(contents);
+    document.collectParseStatistics();
+    REQUIRE(document.applyEdits(edits));
+    REQUIRE(document.parseStatistics().value().shifts == shifts);
+
+    Document fresh(document.toString());
+    REQUIRE(SameTree(document.root(), fresh.root()));
+}
+
+TEST_CASE("Many Edits At Once") {
+    std::string contents;
+    for (int i = 0; i < 200; i++) {
+        contents += "int a" + std::to_string(i) + ";\n";
+    }
+
+    Document batched(contents);
+    Document oneAtATime(contents);
+
+    // Split the pieces up, so a single edit is applied to the piece tree in place
+    for (uint32_t row = 200; row-- > 0;) {
+        Position lineEnd = batched.lineRange(row).end;
+        batched.applyEdits({InsertEdit {.position = lineEnd, .bytes = " "sv}});
+        oneAtATime.applyEdits({InsertEdit {.position = lineEnd, .bytes = " "sv}});
+    }
+
+    // Widens every third declaration and splits its line in two
+    std::vector<std::vector<Edit>> lineEdits;
+    for (uint32_t row = 0; row < 200; row += 3) {
+        Range line = batched.lineRange(row);
+        Position typeEnd = batched.positionAt(line.start.byteOffset + 3);
+
+        lineEdits.push_back({
+            DeleteEdit {.range = Range::Between(line.start, typeEnd)},
+            InsertEdit {.position = line.start, .bytes = "long"sv},
+            InsertEdit {.position = typeEnd, .bytes = "\n"sv},
+        });
+    }
+
+    std::vector<Edit> allEdits;
+    for (const std::vector<Edit>& edits : lineEdits) {
+        allEdits.insert(allEdits.end(), edits.begin(), edits.end());
+    }
+
+    // Enough edits to rebuild the pieces, against few enough to edit them in place
+    REQUIRE(allEdits.size() >= batched.contents().size() / 32);
+    REQUIRE(batched.applyEdits(allEdits));
+
+    for (auto edits = lineEdits.rbegin(); edits != lineEdits.rend(); ++edits) {
+        REQUIRE(edits->size() < oneAtATime.contents().size() / 32);
+        REQUIRE(oneAtATime.applyEdits(*edits));
+    }
+
+    REQUIRE(batched.toString() == oneAtATime.toString());
+    REQUIRE(batched.lineCount() == oneAtATime.lineCount());
+    REQUIRE(batched.lineCount() == 201 + 67);
+    REQUIRE(batched.endPosition() == oneAtATime.endPosition());
+
+    for (uint32_t row = 0; row < batched.lineCount(); row++) {
+        REQUIRE(batched.lineRange(row).start == oneAtATime.lineRange(row).start);
+        REQUIRE(batched.lineRange(row).end == oneAtATime.lineRange(row).end);
+    }
+}
+
+TEST_CASE("Multiple Line Inserts") {
+    Document document(std::string("int a;\nint b;\n"));
+
+    // Starts in the middle of a line and ends in the middle of another
+    document.applyEdits({
+        InsertEdit {.position = document.positionAt(4), .bytes = "x;\nint y;\n  int "sv},
+    });
+
+    REQUIRE(document.toString() == "int x;\nint y;\n  int a;\nint b;\n");
+
+    TSNode a = ts_node_child(document.root(), 2);
+    REQUIRE(ts_node_start_byte(a) == 16);
+    REQUIRE(ts_node_start_point(a).row == 2);
+    REQUIRE(ts_node_start_point(a).column == 2);
+
+    TSNode aName = ts_node_child_by_field_name(a, "declarator", 10);
+    REQUIRE(ts_node_start_point(aName).row == 2);
+    REQUIRE(ts_node_start_point(aName).column == 6);
+
+    TSNode b = ts_node_child(document.root(), 3);
+    REQUIRE(ts_node_start_point(b).row == 3);
+    REQUIRE(ts_node_start_point(b).column == 0);
+    REQUIRE(ts_node_end_point(b).column == 6);
+
+    REQUIRE(ts_node_end_point(document.root()).row == document.endPosition().location.row);
+    REQUIRE(document.endPosition() == document.positionAt(30));
+}
+
+TEST_CASE("Parse Statistics") {
+    Document document(std::string("int a;\nint b;\nint c;\nint d;\n"));
+    REQUIRE(!document.parseStatistics().has_value());
+
+    document.collectParseStatistics();
+    REQUIRE(document.parseStatistics().value().reparses == 0);
+    REQUIRE(document.parseStatistics().value().shifts == 0);
+
+    SECTION("Whitespace Only Edit") {
+        document.applyEdits({
+            InsertEdit {.position = document.positionAt(7), .bytes = "  "sv},
+        });
+
+        REQUIRE(document.parseStatistics().value().reparses == 0);
+        REQUIRE(document.parseStatistics().value().shifts == 1);
+        REQUIRE(document.parseStatistics().value().nodes == 0);
+    }
+
+    SECTION("Structural Edit") {
+        document.applyEdits({
+            DeleteEdit {.range = Range::Between(document.positionAt(4), document.positionAt(5))},
+            InsertEdit {.position = document.positionAt(4), .bytes = "x = 1"sv},
+        });
+
+        const ParseStatistics& statistics = document.parseStatistics().value();
+        REQUIRE(statistics.reparses == 1);
+        REQUIRE(statistics.shifts == 0);
+        REQUIRE(statistics.nodes > 0);
+
+        // The declarations after the edit are reused
+        REQUIRE(statistics.reusedNodes > 0);
+        REQUIRE(statistics.reusedNodes < statistics.nodes);
+    }
+}
+
+TEST_CASE("Reset") {
+    Document document(std::string("int a;\n// clang-format off\nint  b;\n"));
+    document.applyEdits({
+        InsertEdit {.position = document.positionAt(0), .bytes = "  "sv},
+    });
+
+    SECTION("Owned Contents") {
+        document.reset(std::string("int c;\n"));
+
+        REQUIRE(document.toString() == "int c;\n");
+        REQUIRE(document.lineCount() == 2);
+        REQUIRE(document.endPosition() == document.positionAt(7));
+        REQUIRE(!document.isWithinAnUnformattableRange(document.positionAt(3)));
+    }
+
+    SECTION("Borrowed Contents") {
+        std::string contents = "// clang-format off\nint  d;\n";
+        document.resetToBorrowedBuffer(contents);
+
+        REQUIRE(document.toString() == contents);
+        REQUIRE(document.originalContents().data() == contents.data());
+        REQUIRE(document.isWithinAnUnformattableRange(document.positionAt(22)));
+    }
+}
+
+// The unformattable ranges kept up to date through edits have to match the ones found by
+// loading the edited contents from scratch
+void RequireFreshUnformattableRanges(const Document& edited) {
+    Document fresh(edited.toString());
+
+    for (uint32_t offset = 0; offset <= edited.endPosition().byteOffset; offset++) {
+        REQUIRE(edited.isWithinAnUnformattableRange(edited.positionAt(offset)) == fresh.isWithinAnUnformattableRange(fresh.positionAt(offset)));
+    }
+
+    for (uint32_t row = 0; row < edited.lineCount(); row++) {
+        REQUIRE(edited.overlapsUnformattableRange(edited.lineRange(row)) == fresh.overlapsUnformattableRange(fresh.lineRange(row)));
+    }
+}
+
+TEST_CASE("Format Markers") {
+    auto between = [](const Document& document, uint32_t start, uint32_t end) {
+        return Range::Between(document.positionAt(start), document.positionAt(end));
+    };
+
+    SECTION("Created") {
+        Document document(std::string("int a;\n// clang-format of\nint  b;\n"));
+        REQUIRE(!document.isWithinAnUnformattableRange(document.positionAt(30)));
+
+        document.applyEdits({
+            InsertEdit {.position = document.positionAt(25), .bytes = "f"sv},
+        });
+
+        REQUIRE(document.isWithinAnUnformattableRange(document.positionAt(30)));
+        RequireFreshUnformattableRanges(document);
+    }
+
+    SECTION("Created By A New Comment") {
+        Document document(std::string("int a;\nint  b;\n"));
+
+        document.applyEdits({
+            InsertEdit {.position = document.positionAt(7), .bytes = "// tree-sitter-format off\n"sv},
+        });
+
+        REQUIRE(document.isWithinAnUnformattableRange(document.positionAt(36)));
+        RequireFreshUnformattableRanges(document);
+    }
+
+    SECTION("Destroyed") {
+        Document document(std::string("int a;\n// clang-format off\nint  b;\n// clang-format on\nint c;\n"));
+        REQUIRE(document.isWithinAnUnformattableRange(document.positionAt(30)));
+
+        document.applyEdits({
+            DeleteEdit {.range = between(document, 25, 26)},
+        });
+
+        REQUIRE(!document.isWithinAnUnformattableRange(document.positionAt(29)));
+        RequireFreshUnformattableRanges(document);
+    }
+
+    SECTION("Format On Destroyed") {
+        Document document(std::string("int a;\n// clang-format off\nint  b;\n// clang-format on\nint c;\n"));
+        REQUIRE(!document.isWithinAnUnformattableRange(document.positionAt(56)));
+
+        document.applyEdits({
+            DeleteEdit {.range = between(document, 35, 54)},
+        });
+
+        REQUIRE(document.isWithinAnUnformattableRange(document.positionAt(37)));
+        RequireFreshUnformattableRanges(document);
+    }
+
+    SECTION("Trailing Whitespace Added") {
+        Document document(std::string("int a;\n// clang-format off\nint  b;\n// clang-format on\nint c;\n"));
+
+        document.applyEdits({
+            InsertEdit {.position = document.positionAt(26), .bytes = "  \t"sv},
+            InsertEdit {.position = document.positionAt(53), .bytes = " "sv},
+        });
+
+        REQUIRE(document.isWithinAnUnformattableRange(document.positionAt(33)));
+        RequireFreshUnformattableRanges(document);
+    }
+
+    SECTION("Trailing Whitespace Removed") {
+        Document document(std::string("int a;\n// clang-format off   \nint  b;\n"));
+
+        document.applyEdits({
+            DeleteEdit {.range = between(document, 26, 29)},
+        });
+
+        REQUIRE(document.toString() == "int a;\n// clang-format off\nint  b;\n");
+        REQUIRE(document.isWithinAnUnformattableRange(document.positionAt(30)));
+        RequireFreshUnformattableRanges(document);
+    }
+
+    SECTION("Trailing Text Added") {
+        Document document(std::string("int a;\n// clang-format off\nint  b;\n"));
+
+        document.applyEdits({
+            InsertEdit {.position = document.positionAt(26), .bytes = " x"sv},
+        });
+
+        REQUIRE(!document.isWithinAnUnformattableRange(document.positionAt(32)));
+        RequireFreshUnformattableRanges(document);
+    }
+}
+
+TEST_CASE("Loading Files") {
+    auto write = [](const std::string& name, const std::string& contents) {
+        std::filesystem::path file = std::filesystem::temp_directory_path() / name;
+        std::ofstream(file, std::ios::binary) << contents;
+
+        return file;
+    };
+
+    SECTION("Empty File") {
+        std::filesystem::path file = write("tsf_document_empty.cpp", "");
+
+        Document document(file);
+        REQUIRE(document.toString().empty());
+        REQUIRE(document.lineCount() == 1);
+        REQUIRE(document.endPosition() == document.startPosition());
+
+        document.applyEdits({
+            InsertEdit {.position = document.startPosition(), .bytes = "int a;\n"sv},
+        });
+        REQUIRE(document.toString() == "int a;\n");
+
+        std::filesystem::remove(file);
+    }
+
+    SECTION("No Trailing New Line") {
+        std::filesystem::path file = write("tsf_document_no_new_line.cpp", "int a;\nint b;");
+
+        Document document(file);
+        REQUIRE(document.toString() == "int a;\nint b;");
+        REQUIRE(document.lineCount() == 2);
+        REQUIRE(document.lineRange(1).end == document.endPosition());
+        REQUIRE(document.endPosition().byteOffset == 13);
+
+        // Edits go to the document's own buffer, never to the mapped file
+        document.applyEdits({
+            InsertEdit {.position = document.endPosition(), .bytes = "\n"sv},
+            InsertEdit {.position = document.positionAt(4), .bytes = " "sv},
+        });
+        REQUIRE(document.toString() == "int  a;\nint b;\n");
+        REQUIRE(document.originalContents() == "int a;\nint b;");
+
+        std::ifstream written(file, std::ios::binary);
+        REQUIRE(std::string(std::istreambuf_iterator<char>(written), {}) == "int a;\nint b;");
+
+        std::filesystem::remove(file);
+    }
+}
+
+TEST_CASE("Borrowed Buffer") {
+    const std::string contents = "int a;\nint b;\n";
+    std::string buffer = contents;
+
+    Document document = Document::FromBorrowedBuffer(buffer);
+    REQUIRE(document.originalContents().data() == buffer.data());
+    REQUIRE(document.toString() == contents);
+
+    document.applyEdits({
+        DeleteEdit {.range = Range::Between(document.positionAt(4), document.positionAt(5))},
+        InsertEdit {.position = document.positionAt(4), .bytes = "x"sv},
+        InsertEdit {.position = document.positionAt(14), .bytes = "int c;\n"sv},
+    });
+
+    REQUIRE(document.toString() == "int x;\nint b;\nint c;\n");
+    REQUIRE(buffer == contents);
+    REQUIRE(document.originalContents() == contents);
+
+    // The original pieces still point into the borrowed buffer, and the edits into the
+    // document's own
+    for (std::string_view piece : document.contents()) {
+        bool borrowed = piece.data() >= buffer.data() && piece.data() + piece.size() <= buffer.data() + buffer.size();
+        REQUIRE(borrowed == (piece.find_first_of("xc") == std::string_view::npos));
+    }
+}
+
+TEST_CASE("Taking Over Inserted Text") {
+    Document document(std::string("int a;\nint b;\n"));
+
+    AddBuffer text;
+    std::string_view kept = text.append("int c;\n"sv);
+    std::string copied = "int d;\n";
+
+    std::vector<AddBuffer> texts;
+    texts.push_back(std::move(text));
+
+    REQUIRE(document.applyEdits({
+        InsertEdit {.position = document.positionAt(7), .bytes = kept},
+        InsertEdit {.position = document.positionAt(14), .bytes = copied},
+    }, std::move(texts)));
+
+    copied[4] = 'x';
+    REQUIRE(document.toString() == "int a;\nint c;\nint b;\nint d;\n");
+
+    // The text from the buffer wasn't copied, and the rest was
+    bool foundKept = false;
+    for (std::string_view piece : document.contents()) {
+        foundKept = foundKept || piece.data() == kept.data();
+        REQUIRE(piece.data() != copied.data());
+    }
+    REQUIRE(foundKept);
+}
+
+TEST_CASE("Cancel Parse") {
+    Document document(std::string("int a;\nint b;\n"));
+
+    std::atomic_size_t cancelled = 1;
+    document.setCancellationFlag(&cancelled);
+
+    std::vector<Edit> edits = {
+        DeleteEdit {.range = Range::Between(document.positionAt(7), document.positionAt(14))},
+        InsertEdit {.position = document.positionAt(0), .bytes = "\n"sv},
+    };
+
+    REQUIRE(!document.applyEdits(edits));
+    REQUIRE(document.toString() == "int a;\nint b;\n");
+    REQUIRE(document.lineCount() == 3);
+    REQUIRE(ts_node_end_byte(document.root()) == 14);
+
+    cancelled = 0;
+
+    REQUIRE(document.applyEdits(edits));
+    REQUIRE(document.toString() == "\nint a;\n");
+    REQUIRE(document.lineCount() == 3);
+}
+
+TEST_CASE("Cancel Parse With Format Markers") {
+    std::string contents = "int a;\n// clang-format off\nint  b;\n// clang-format on\nint c;\n";
+    Document document(contents);
+
+    std::atomic_size_t cancelled = 1;
+    document.setCancellationFlag(&cancelled);
+
+    // Takes out the "format on" comment and adds lines before the "format off" one
+    std::vector<Edit> edits = {
+        InsertEdit {.position = document.positionAt(7), .bytes = "int d;\n\n"sv},
+        DeleteEdit {.range = Range::Between(document.positionAt(35), document.positionAt(53))},
+    };
+
+    REQUIRE(!document.applyEdits(edits));
+
+    REQUIRE(document.toString() == contents);
+    REQUIRE(document.lineCount() == 6);
+    REQUIRE(document.lineRange(3).start == document.positionAt(35));
+    REQUIRE(document.lineRange(3).end == document.positionAt(53));
+    REQUIRE(document.endPosition() == document.positionAt(uint32_t(contents.size())));
+
+    REQUIRE(!document.isWithinAnUnformattableRange(document.positionAt(3)));
+    REQUIRE(document.isWithinAnUnformattableRange(document.positionAt(30)));
+    REQUIRE(!document.isWithinAnUnformattableRange(document.positionAt(56)));
+
+    cancelled = 0;
+
+    REQUIRE(document.applyEdits(edits));
+    REQUIRE(document.toString() == "int a;\nint d;\n\n// clang-format off\nint  b;\n\nint c;\n");
+    REQUIRE(document.lineCount() == 8);
+    REQUIRE(document.isWithinAnUnformattableRange(document.positionAt(44)));
+}
+
+TEST_CASE("Encoding") {
+    Document document(std::string("int a;\n"));
+    REQUIRE(document.isValidUtf8());
+    REQUIRE(document.isAscii());
+
+    SECTION("Non ASCII Insert") {
+        document.applyEdits({
+            InsertEdit {.position = document.positionAt(6), .bytes = " // \xC3\xA9"sv},
+        });
+
+        REQUIRE(document.isValidUtf8());
+        REQUIRE(!document.isAscii());
+    }
+
+    SECTION("Invalid Contents") {
+        // An overlong encoding of '/'
+        REQUIRE(!document.reset(std::string("int a; \xC0\xAF\n")));
+
+        REQUIRE(!document.isValidUtf8());
+        REQUIRE(document.firstInvalidByte() == 7);
+        REQUIRE(document.toString() == "int a; \xC0\xAF\n");
+
+        REQUIRE(document.reset(std::string("int \xC3\xA9;\n")));
+        REQUIRE(document.isValidUtf8());
+        REQUIRE(!document.isAscii());
+    }
+}
+
+TEST_CASE("Columns After Non ASCII") {
+    // The é is two bytes, and columns count bytes, like tree-sitter's
+    Document document(std::string("auto s = \"\xC3\xA9\"; int x = 1;\n"));
+
+    document.applyEdits({
+        DeleteEdit {.range = Range::Between(document.positionAt(23), document.positionAt(24))},
+        InsertEdit {.position = document.positionAt(23), .bytes = "10"sv},
+    });
+
+    REQUIRE(document.toString() == "auto s = \"\xC3\xA9\"; int x = 10;\n");
+    REQUIRE(document.positionAt(23).location.column == 23);
+    REQUIRE(document.displayColumn(document.positionAt(23)) == 22);
+
+    TSNode number = ts_node_descendant_for_byte_range(document.root(), 23, 25);
+    REQUIRE(ts_node_start_byte(number) == 23);
+    REQUIRE(ts_node_start_point(number).column == document.positionAt(23).location.column);
+    REQUIRE(ts_node_end_point(number).column == document.positionAt(25).location.column);
+
+    Range newLine = document.nextNewLine(document.startPosition());
+    REQUIRE(newLine.start.location.column == 26);
+    REQUIRE(document.slice(document.range()).nextNewLine(document.startPosition()).start == newLine.start);
+}
@@ -0,0 +1,325 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <tree-sitter-format/document/DocumentSlice.h>
+#include <tree-sitter-format/document/ScanKernels.h>
+
+#include <string>
+#include <vector>
+
+using namespace tree_sitter_format;
+using namespace std::literals::string_view_literals;
+
+Position At(uint32_t byteOffset, uint32_t column) {
+    return Position {
+        .location = TSPoint {
+            .row = 0,
+            .column = column,
+        },
+        .byteOffset = byteOffset,
+    };
+}
+
+TEST_CASE("Slices Across Pieces") {
+    // Every byte is in a piece of its own, so everything has to cross piece boundaries
+    std::string_view text = "  h\xC3\xA9llo \t"sv;
+    std::vector<std::string_view> bytes;
+    for (size_t i = 0; i < text.size(); i++) {
+        bytes.push_back(text.substr(i, 1));
+    }
+
+    PieceTree pieces;
+    pieces.assign(bytes.begin(), bytes.end());
+
+    DocumentSlice slice(pieces, Range::Between(At(0, 0), At(10, 10)));
+
+    SECTION("Contents") {
+        REQUIRE(slice.toString() == text);
+        REQUIRE(slice.contents().size() == text.size());
+        REQUIRE(slice.characterAt(2) == 'h');
+    }
+
+    SECTION("Code Points") {
+        std::u32string codePoints;
+        for (UnicodeIterator character = slice.begin(); character != slice.end(); ++character) {
+            codePoints.push_back(*character);
+        }
+
+        REQUIRE(codePoints == U"  héllo \t");
+    }
+
+    SECTION("Columns Count Bytes") {
+        // Like tree-sitter's, so positions from the iterator and from the document agree
+        UnicodeIterator character = slice.begin();
+        while (*character != U'l') {
+            ++character;
+        }
+
+        REQUIRE(character.currentPosition() == At(5, 5));
+        REQUIRE(CountLeadBytes(slice.contentsAtAsString(Range::Between(At(0, 0), character.currentPosition()))) == 4);
+
+        --character;
+        REQUIRE(*character == U'\u00E9');
+        REQUIRE(character.currentPosition() == At(3, 3));
+    }
+
+    SECTION("Trim") {
+        DocumentSlice trimmed = slice.trimFront().trimBack();
+
+        REQUIRE(trimmed.toString() == "h\xC3\xA9llo");
+        REQUIRE(trimmed.startPosition() == At(2, 2));
+        REQUIRE(trimmed.endPosition() == At(8, 8));
+        REQUIRE(trimmed.is("h\xC3\xA9llo"sv));
+        REQUIRE(trimmed.startsWith("h\xC3\xA9"sv));
+        REQUIRE(!trimmed.startsWith("he"sv));
+    }
+
+    SECTION("Elements Between") {
+        UnicodeIterator start = slice.begin();
+        for (int i = 0; i < 3; i++) {
+            ++start;
+        }
+
+        UnicodeIterator end = start;
+        for (int i = 0; i < 2; i++) {
+            ++end;
+        }
+
+        std::string between;
+        for (std::string_view element : UnicodeIterator::ElementsBetween(start, end)) {
+            between.append(element);
+        }
+
+        REQUIRE(between == "\xC3\xA9l");
+        REQUIRE(end.currentPosition() == At(6, 6));
+    }
+}
+
+TEST_CASE("Iterating Backwards") {
+    std::string_view text = "a\xC3\xA9\nx\xE2\x82\xAC \n\t\n"sv;
+    std::vector<std::string_view> bytes;
+    for (size_t i = 0; i < text.size(); i++) {
+        bytes.push_back(text.substr(i, 1));
+    }
+
+    PieceTree pieces;
+    pieces.assign(bytes.begin(), bytes.end());
+
+    Position end {
+        .location = TSPoint {
+            .row = 3,
+            .column = 0,
+        },
+        .byteOffset = uint32_t(text.size()),
+    };
+    DocumentSlice slice(pieces, Range::Between(At(0, 0), end));
+
+    SECTION("Code Points") {
+        std::vector<UnicodeIterator> forwards;
+        for (UnicodeIterator character = slice.begin(); character != slice.end(); ++character) {
+            forwards.push_back(character);
+        }
+
+        UnicodeIterator character = slice.end();
+        for (auto expected = forwards.rbegin(); expected != forwards.rend(); ++expected) {
+            REQUIRE(!character.atStart());
+            --character;
+
+            REQUIRE(*character == **expected);
+            REQUIRE(character.currentPosition() == expected->currentPosition());
+        }
+
+        REQUIRE(character.atStart());
+    }
+
+    SECTION("Truncated Sequence") {
+        // The lead byte promises two continuation bytes but only has one, so going forwards reads
+        // it as one code point, and going backwards has to as well
+        std::string_view truncated = "a\xE2\x82!"sv;
+        PieceTree truncatedPieces;
+        truncatedPieces.assign(&truncated, &truncated + 1);
+        DocumentSlice truncatedSlice(truncatedPieces, Range::Between(At(0, 0), At(4, 4)));
+
+        UnicodeIterator character = truncatedSlice.end();
+        --character;
+        REQUIRE(*character == U'!');
+        --character;
+        REQUIRE(character.currentPosition() == At(1, 1));
+        --character;
+        REQUIRE(*character == U'a');
+        REQUIRE(character.atStart());
+    }
+
+    SECTION("Trim Back") {
+        DocumentSlice trimmed = slice.trimBack();
+
+        REQUIRE(trimmed.toString() == "a\xC3\xA9\nx\xE2\x82\xAC");
+        REQUIRE(trimmed.endPosition().byteOffset == 8);
+        REQUIRE(trimmed.endPosition().location.row == 1);
+        REQUIRE(trimmed.endPosition().location.column == 4);
+    }
+
+    SECTION("To Previous New Line") {
+        Position euro {
+            .location = TSPoint {
+                .row = 1,
+                .column = 4,
+            },
+            .byteOffset = 8,
+        };
+        Range line = slice.toPreviousNewLine(euro);
+
+        REQUIRE(line.start.byteOffset == 4);
+        REQUIRE(line.start.location.row == 1);
+        REQUIRE(line.start.location.column == 0);
+        REQUIRE(line.end == euro);
+    }
+}
+
+TEST_CASE("Previous New Line From Columns") {
+    std::string_view text = "ab\n cd\n"sv;
+    PieceTree pieces;
+    pieces.assign(text);
+
+    Position end {
+        .location = TSPoint {
+            .row = 2,
+            .column = 0,
+        },
+        .byteOffset = 7,
+    };
+    DocumentSlice slice(pieces, Range::Between(At(0, 0), end));
+
+    Position d {
+        .location = TSPoint {
+            .row = 1,
+            .column = 2,
+        },
+        .byteOffset = 5,
+    };
+
+    SECTION("To Previous New Line") {
+        Range line = slice.toPreviousNewLine(d);
+        REQUIRE(line.start.byteOffset == 3);
+        REQUIRE(line.start.location.row == 1);
+        REQUIRE(line.start.location.column == 0);
+    }
+
+    SECTION("Stops At The Slice Start") {
+        Position c {
+            .location = TSPoint {
+                .row = 1,
+                .column = 1,
+            },
+            .byteOffset = 4,
+        };
+
+        Range line = slice.slice(Range::Between(c, end)).toPreviousNewLine(d);
+        REQUIRE(line.start == c);
+    }
+}
+
+TEST_CASE("Iterating Over ASCII Runs") {
+    std::string_view text = "ab cd\\\nef\xC3\xA9gh\n  ij"sv;
+    std::vector<std::string_view> pieces = {text.substr(0, 4), text.substr(4, 7), text.substr(11)};
+
+    PieceTree tree;
+    tree.assign(pieces.begin(), pieces.end());
+
+    Position end {
+        .location = TSPoint {
+            .row = 1,
+            .column = 4,
+        },
+        .byteOffset = uint32_t(text.size()),
+    };
+    DocumentSlice slice(tree, Range::Between(At(0, 0), end));
+
+    SECTION("Runs") {
+        UnicodeIterator character = slice.begin();
+        REQUIRE(character.asciiRun() == "ab c"sv);
+
+        character.advanceAscii(4);
+        REQUIRE(*character == U'd');
+        REQUIRE(character.asciiRun() == "d\\"sv);
+    }
+
+    SECTION("Same As Stepping") {
+        auto isWord = [](char32_t character) {
+            return character != U' ' && character != U'\n';
+        };
+
+        for (UnicodeIterator start = slice.begin(); !start.atEnd(); ++start) {
+            UnicodeIterator stepped = start;
+            uint32_t steps = 0;
+            while (!stepped.atEnd() && isWord(*stepped)) {
+                ++stepped;
+                steps++;
+            }
+
+            UnicodeIterator advanced = start;
+            REQUIRE(advanced.advanceWhile(isWord) == steps);
+            REQUIRE(advanced.currentPosition() == stepped.currentPosition());
+            REQUIRE(*advanced == *stepped);
+
+            // Stepping over everything has to get the rows right for escaped and unescaped new lines
+            UnicodeIterator all = start;
+            all.advanceWhile([](char32_t) { return true; });
+            REQUIRE(all.currentPosition() == end);
+        }
+    }
+
+    SECTION("After Stepping Backwards") {
+        // Stepping backwards leaves the iterator at different offsets into the pieces than
+        // stepping forwards does, but the runs and where advancing over them ends up are the same
+        std::vector<UnicodeIterator> forwards;
+        for (UnicodeIterator character = slice.begin(); !character.atEnd(); ++character) {
+            forwards.push_back(character);
+        }
+
+        UnicodeIterator backwards = slice.end();
+        for (auto forward = forwards.rbegin(); forward != forwards.rend(); ++forward) {
+            --backwards;
+            REQUIRE(backwards.currentPosition() == forward->currentPosition());
+            REQUIRE(backwards.asciiRun() == forward->asciiRun());
+
+            std::string_view run = backwards.asciiRun();
+            if (!run.empty()) {
+                UnicodeIterator advancedBackwards = backwards;
+                UnicodeIterator advancedForwards = *forward;
+                advancedBackwards.advanceAscii(run.size());
+                advancedForwards.advanceAscii(run.size());
+                REQUIRE(advancedBackwards.currentPosition() == advancedForwards.currentPosition());
+                REQUIRE(*advancedBackwards == *advancedForwards);
+            }
+        }
+    }
+}
+
+TEST_CASE("ASCII Runs After Stepping Back Over A Piece Boundary") {
+    std::vector<std::string_view> pieces = {"ab"sv, "cd"sv};
+
+    PieceTree tree;
+    tree.assign(pieces.begin(), pieces.end());
+
+    DocumentSlice slice(tree, Range::Between(At(0, 0), At(4, 4)));
+
+    UnicodeIterator character = slice.end();
+    --character;
+    --character;
+    REQUIRE(*character == U'c');
+    REQUIRE(character.asciiRun() == "cd"sv);
+
+    --character;
+    REQUIRE(*character == U'b');
+    REQUIRE(character.asciiRun() == "b"sv);
+
+    character.advanceAscii(1);
+    REQUIRE(*character == U'c');
+    REQUIRE(character.currentPosition() == At(2, 2));
+    REQUIRE(character.asciiRun() == "cd"sv);
+
+    --character;
+    --character;
+    REQUIRE(character.advanceWhile([](char32_t) { return true; }) == 4);
+    REQUIRE(character.currentPosition() == At(4, 4));
+}
@@ -0,0 +1,93 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <tree-sitter-format/document/DocumentWriter.h>
+
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace tree_sitter_format;
+using namespace std::literals::string_view_literals;
+
+std::string ReadBack(const std::filesystem::path& file) {
+    std::ifstream input(file, std::ios::in | std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+}
+
+TEST_CASE("Write Document") {
+    std::filesystem::path file = std::filesystem::temp_directory_path() / "tree-sitter-format-document-writer.cpp";
+
+    SECTION("Empty") {
+        Document document(std::string(""));
+
+        REQUIRE(WriteDocument(file, document));
+        REQUIRE(ReadBack(file).empty());
+    }
+
+    SECTION("Unedited") {
+        Document document(std::string("int a;\nint b;\n"));
+
+        REQUIRE(WriteDocument(file, document));
+        REQUIRE(ReadBack(file) == "int a;\nint b;\n");
+    }
+
+    SECTION("More Pieces Than One Batch") {
+        // Each insert splits a piece, leaving the document in thousands of pieces
+        Document document(std::string(4000, ';'));
+
+        std::vector<Edit> edits;
+        for (uint32_t i = 0; i < 4000; i += 2) {
+            edits.push_back(InsertEdit {.position = document.positionAt(i), .bytes = "\n"sv});
+        }
+        document.applyEdits(std::move(edits));
+
+        REQUIRE(document.contents().size() > 2048);
+        REQUIRE(WriteDocument(file, document));
+        REQUIRE(ReadBack(file) == document.toString());
+    }
+
+    SECTION("Back To The File It Was Loaded From") {
+        {
+            std::ofstream output(file, std::ios::out | std::ios::binary);
+            output << std::string(100000, ';');
+        }
+
+        std::filesystem::permissions(file, std::filesystem::perms::owner_read | std::filesystem::perms::owner_write);
+
+        // The document reads its unedited pieces from the file itself
+        Document document(file);
+
+        std::vector<Edit> edits;
+        for (uint32_t i = 0; i < 100000; i += 1000) {
+            edits.push_back(InsertEdit {.position = document.positionAt(i), .bytes = "\n"sv});
+        }
+        document.applyEdits(std::move(edits));
+
+        std::string expected = document.toString();
+        REQUIRE(WriteDocument(file, document));
+        REQUIRE(ReadBack(file) == expected);
+        REQUIRE(document.toString() == expected);
+        REQUIRE(std::filesystem::status(file).permissions() == (std::filesystem::perms::owner_read | std::filesystem::perms::owner_write));
+
+        // Nothing is left behind next to the file
+        size_t files = 0;
+        for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(file.parent_path())) {
+            if (entry.path().filename().string().starts_with(file.filename().string())) {
+                files++;
+            }
+        }
+        REQUIRE(files == 1);
+    }
+
+    SECTION("Into A Directory That Doesn't Exist") {
+        Document document(std::string("int a;\n"));
+
+        REQUIRE_FALSE(WriteDocument(file.parent_path() / "tree-sitter-format-missing" / "file.cpp", document));
+        REQUIRE(errno == ENOENT);
+    }
+
+    std::filesystem::remove(file);
+}
@@ -0,0 +1,133 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <tree-sitter-format/document/EditMerger.h>
+
+#include <algorithm>
+#include <span>
+#include <vector>
+
+using namespace tree_sitter_format;
+using namespace std::literals::string_view_literals;
+
+Position At(uint32_t column) {
+    return Position {
+        .location = TSPoint {
+            .row = 0,
+            .column = column,
+        },
+        .byteOffset = column,
+    };
+}
+
+Edit Delete(uint32_t start, uint32_t end) {
+    return DeleteEdit {.range = Range::Between(At(start), At(end))};
+}
+
+Edit Insert(uint32_t position, std::string_view bytes) {
+    return InsertEdit {.position = At(position), .bytes = bytes};
+}
+
+TEST_CASE("Merge Edits") {
+    EditMerger merger;
+    REQUIRE(merger.add(std::vector<Edit> {Delete(4, 8), Insert(4, " "sv)}));
+
+    SECTION("Separate Edits") {
+        REQUIRE(merger.add(std::vector<Edit> {Insert(2, "\n"sv), Delete(10, 12)}));
+        REQUIRE(merger.take().size() == 4);
+        REQUIRE(merger.empty());
+    }
+
+    SECTION("Overlapping Delete") {
+        REQUIRE_FALSE(merger.add(std::vector<Edit> {Delete(6, 10)}));
+        REQUIRE(merger.take().size() == 2);
+    }
+
+    SECTION("Insert In A Delete") {
+        REQUIRE_FALSE(merger.add(std::vector<Edit> {Insert(6, " "sv)}));
+    }
+
+    SECTION("Touching Edits") {
+        REQUIRE(merger.add(std::vector<Edit> {Insert(8, " "sv)}));
+        REQUIRE(merger.add(std::vector<Edit> {Delete(2, 4)}));
+        REQUIRE(merger.add(std::vector<Edit> {Delete(8, 10)}));
+        REQUIRE(merger.take().size() == 5);
+    }
+
+    SECTION("Inserts At One Position") {
+        REQUIRE_FALSE(merger.add(std::vector<Edit> {Insert(4, "\t"sv)}));
+    }
+
+    SECTION("Overlapping Edits Of One Group") {
+        REQUIRE(merger.add(std::vector<Edit> {Delete(10, 14), Delete(12, 16), Insert(12, " "sv)}));
+        REQUIRE_FALSE(merger.add(std::vector<Edit> {Delete(15, 17)}));
+        REQUIRE(merger.add(std::vector<Edit> {Delete(16, 17)}));
+    }
+
+    SECTION("All Or Nothing") {
+        REQUIRE_FALSE(merger.add(std::vector<Edit> {Insert(0, " "sv), Delete(7, 9)}));
+        REQUIRE(merger.take().size() == 2);
+    }
+
+    SECTION("Later Edits After A Conflict") {
+        REQUIRE_FALSE(merger.add(std::vector<Edit> {Delete(7, 9)}));
+        REQUIRE(merger.add(std::vector<Edit> {Delete(9, 11)}));
+        REQUIRE(merger.take().size() == 3);
+    }
+}
+
+uint32_t Rebase(uint32_t offset, std::vector<Edit> edits, bool insertsAfter) {
+    std::ranges::stable_sort(edits);
+
+    RebasedOffset rebased {.byteOffset = offset, .insertsAfter = insertsAfter};
+    RebaseOffsets(std::span(&rebased, 1), edits);
+    return rebased.byteOffset;
+}
+
+TEST_CASE("Rebase Offsets") {
+    std::vector<Edit> edits {Delete(4, 8), Insert(4, " "sv), Insert(10, "\n\n"sv)};
+
+    SECTION("Before The Edits") {
+        REQUIRE(Rebase(2, edits, true) == 2);
+    }
+
+    SECTION("Between The Edits") {
+        REQUIRE(Rebase(9, edits, true) == 6);
+    }
+
+    SECTION("Deleted Offset") {
+        REQUIRE(Rebase(6, edits, true) == 5);
+    }
+
+    SECTION("Inserts At The Offset") {
+        REQUIRE(Rebase(10, edits, true) == 7);
+        REQUIRE(Rebase(10, edits, false) == 9);
+        REQUIRE(Rebase(4, edits, true) == 4);
+        REQUIRE(Rebase(4, edits, false) == 5);
+    }
+
+    SECTION("Overlapping Deletes") {
+        std::vector<Edit> overlapping {Delete(2, 6), Delete(4, 8)};
+        REQUIRE(Rebase(10, overlapping, true) == 4);
+    }
+
+    SECTION("Several Offsets") {
+        std::vector<Edit> sorted {Delete(2, 6), Insert(3, "abc"sv), Delete(4, 8), Insert(8, " "sv), Insert(12, "\n"sv)};
+        std::ranges::stable_sort(sorted);
+
+        // A delete reaching past one offset is counted for the next one too
+        std::vector<RebasedOffset> offsets {
+            {.byteOffset = 3, .insertsAfter = true},
+            {.byteOffset = 5, .insertsAfter = false},
+            {.byteOffset = 8, .insertsAfter = true},
+            {.byteOffset = 8, .insertsAfter = false},
+            {.byteOffset = 12, .insertsAfter = false},
+        };
+        RebaseOffsets(offsets, sorted);
+
+        REQUIRE(offsets[0].byteOffset == 2);
+        REQUIRE(offsets[1].byteOffset == 5);
+        REQUIRE(offsets[2].byteOffset == 5);
+        REQUIRE(offsets[3].byteOffset == 6);
+        REQUIRE(offsets[4].byteOffset == 11);
+    }
+}
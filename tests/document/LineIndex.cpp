@@ -0,0 +1,85 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <tree-sitter-format/document/LineIndex.h>
+
+#include <vector>
+
+using namespace tree_sitter_format;
+using namespace std::literals::string_view_literals;
+
+Position At(uint32_t byteOffset) {
+    // The line index only looks at byte offsets
+    return Position {
+        .byteOffset = byteOffset,
+    };
+}
+
+TEST_CASE("Assign") {
+    LineIndex lines;
+
+    SECTION("Empty") {
+        lines.assign(""sv);
+
+        REQUIRE(lines.lineCount() == 1);
+        REQUIRE(lines.lineStart(0) == 0);
+    }
+
+    SECTION("Lines") {
+        lines.assign("int a;\r\n\nint b;"sv);
+
+        REQUIRE(lines.lineCount() == 3);
+        REQUIRE(lines.lineStart(1) == 8);
+        REQUIRE(lines.lineStart(2) == 9);
+
+        REQUIRE(lines.rowAt(0) == 0);
+        REQUIRE(lines.rowAt(7) == 0);
+        REQUIRE(lines.rowAt(8) == 1);
+        REQUIRE(lines.rowAt(12) == 2);
+    }
+}
+
+TEST_CASE("Update") {
+    LineIndex lines;
+    lines.assign("a\nb\nc\n"sv);
+
+    SECTION("Insert") {
+        std::vector<Edit> edits = {
+            InsertEdit{.position = At(4), .bytes = "x\ny"sv},
+            InsertEdit{.position = At(0), .bytes = "\n"sv},
+        };
+        lines.update(edits);
+
+        // "\na\nb\nx\nyc\n"
+        REQUIRE(lines.lineCount() == 6);
+        REQUIRE(lines.lineStart(1) == 1);
+        REQUIRE(lines.lineStart(2) == 3);
+        REQUIRE(lines.lineStart(3) == 5);
+        REQUIRE(lines.lineStart(4) == 7);
+        REQUIRE(lines.lineStart(5) == 10);
+    }
+
+    SECTION("Delete") {
+        std::vector<Edit> edits = {
+            DeleteEdit{.range = Range{.start = At(3), .end = At(4)}},
+            DeleteEdit{.range = Range{.start = At(0), .end = At(1)}},
+        };
+        lines.update(edits);
+
+        // "\nbc\n"
+        REQUIRE(lines.lineCount() == 3);
+        REQUIRE(lines.lineStart(1) == 1);
+        REQUIRE(lines.lineStart(2) == 4);
+    }
+
+    SECTION("Replace") {
+        std::vector<Edit> edits = {
+            DeleteEdit{.range = Range{.start = At(1), .end = At(4)}},
+            InsertEdit{.position = At(1), .bytes = " "sv},
+        };
+        lines.update(edits);
+
+        // "a c\n"
+        REQUIRE(lines.lineCount() == 2);
+        REQUIRE(lines.lineStart(1) == 4);
+    }
+}
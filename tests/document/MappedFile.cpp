@@ -0,0 +1,56 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <tree-sitter-format/document/MappedFile.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace tree_sitter_format;
+
+std::filesystem::path WriteTemporaryFile(const std::string& name, const std::string& contents) {
+    std::filesystem::path file = std::filesystem::temp_directory_path() / name;
+    std::ofstream(file, std::ios::binary) << contents;
+
+    return file;
+}
+
+TEST_CASE("Mapped Files") {
+    SECTION("Contents") {
+        std::filesystem::path file = WriteTemporaryFile("tsf_mapped_file.cpp", "int a;\nint b;");
+
+        std::optional<MappedFile> mapped = MappedFile::Map(file);
+        REQUIRE(mapped.has_value());
+        REQUIRE(mapped->contents() == "int a;\nint b;");
+
+        std::filesystem::remove(file);
+    }
+
+    SECTION("Empty File") {
+        std::filesystem::path file = WriteTemporaryFile("tsf_mapped_empty_file.cpp", "");
+
+        std::optional<MappedFile> mapped = MappedFile::Map(file);
+        REQUIRE(mapped.has_value());
+        REQUIRE(mapped->contents().empty());
+
+        std::filesystem::remove(file);
+    }
+
+    SECTION("Moved") {
+        std::filesystem::path file = WriteTemporaryFile("tsf_mapped_moved_file.cpp", "int a;\n");
+
+        MappedFile moved = std::move(MappedFile::Map(file).value());
+        MappedFile assigned;
+        assigned = std::move(moved);
+
+        REQUIRE(moved.contents().empty());
+        REQUIRE(assigned.contents() == "int a;\n");
+
+        std::filesystem::remove(file);
+    }
+
+    SECTION("Not Mappable") {
+        REQUIRE(!MappedFile::Map(std::filesystem::temp_directory_path() / "tsf_missing_file.cpp").has_value());
+        REQUIRE(!MappedFile::Map(std::filesystem::temp_directory_path()).has_value());
+    }
+}
@@ -0,0 +1,94 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <tree-sitter-format/document/PieceAlgorithms.h>
+
+#include <vector>
+
+using namespace tree_sitter_format;
+using namespace std::literals::string_view_literals;
+
+std::vector<uint32_t> FindAllIn(const std::vector<std::string_view>& pieces, std::string_view needle) {
+    uint32_t length = 0;
+    for(std::string_view piece : pieces) {
+        length += uint32_t(piece.size());
+    }
+
+    std::vector<uint32_t> matches;
+    FindAll(pieces.begin(), 0, length, needle, [&](uint32_t offset) {
+        matches.push_back(offset);
+    });
+
+    return matches;
+}
+
+TEST_CASE("Find All") {
+    SECTION("Single Piece") {
+        REQUIRE(FindAllIn({"a-b-c"sv}, "-"sv) == std::vector<uint32_t>{1, 3});
+        REQUIRE(FindAllIn({"a-b-c"sv}, "x"sv).empty());
+    }
+
+    SECTION("Across Pieces") {
+        std::vector<std::string_view> pieces = {"// clang-fo"sv, "r"sv, "mat off // clang"sv, "-format on"sv};
+        REQUIRE(FindAllIn(pieces, "-format o"sv) == std::vector<uint32_t>{8, 28});
+    }
+
+    SECTION("Overlapping") {
+        REQUIRE(FindAllIn({"aa"sv, "a"sv, "a"sv}, "aa"sv) == std::vector<uint32_t>{0, 1, 2});
+    }
+
+    SECTION("Offset") {
+        std::vector<std::string_view> pieces = {"--x"sv, "--"sv};
+        std::vector<uint32_t> matches;
+        FindAll(pieces.begin(), 1, 3, "-"sv, [&](uint32_t offset) {
+            matches.push_back(offset);
+        });
+
+        REQUIRE(matches == std::vector<uint32_t>{0, 2});
+    }
+}
+
+Range NextNewLineIn(const std::vector<std::string_view>& pieces, uint32_t byteCount) {
+    return NextNewLine(pieces.begin(), pieces.end(), 0, byteCount, Position());
+}
+
+TEST_CASE("Next New Line") {
+    SECTION("Columns Count Bytes") {
+        std::string line;
+        for (int i = 0; i < 20; i++) {
+            line += "\xC3\xA9";
+        }
+        line += "\nx";
+
+        Range newLine = NextNewLineIn({line}, uint32_t(line.size()));
+        REQUIRE(newLine.start.byteOffset == 40);
+        REQUIRE(newLine.start.location.column == 40);
+        REQUIRE(newLine.end.byteOffset == 41);
+        REQUIRE(newLine.end.location.row == 1);
+    }
+
+    SECTION("Escaped") {
+        std::vector<std::string_view> pieces = {"a \\"sv, "\n b \\\\"sv, "\nc"sv};
+
+        Range newLine = NextNewLineIn(pieces, 12);
+        REQUIRE(newLine.start.byteOffset == 9);
+        REQUIRE(newLine.start.location.column == 9);
+        REQUIRE(newLine.end.byteOffset == 10);
+    }
+
+    SECTION("Carriage Return Across Pieces") {
+        std::vector<std::string_view> pieces = {"abc\r"sv, "\ndef"sv};
+
+        Range newLine = NextNewLineIn(pieces, 8);
+        REQUIRE(newLine.end.byteOffset == 5);
+        REQUIRE(newLine.end.location.row == 1);
+    }
+
+    SECTION("Byte Limit") {
+        std::vector<std::string_view> pieces = {"abc"sv, "def\n"sv};
+
+        Range newLine = NextNewLineIn(pieces, 5);
+        REQUIRE(newLine.start == newLine.end);
+        REQUIRE(newLine.start.byteOffset == 5);
+        REQUIRE(newLine.start.location.column == 5);
+    }
+}
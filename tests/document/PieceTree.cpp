@@ -0,0 +1,150 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <tree-sitter-format/document/PieceTree.h>
+
+#include <string>
+#include <vector>
+
+using namespace tree_sitter_format;
+using namespace std::literals::string_view_literals;
+
+std::string Contents(const PieceTree& pieces) {
+    std::string s;
+    for(std::string_view piece : pieces) {
+        s += piece;
+    }
+
+    return s;
+}
+
+std::string ContentsBackwards(const PieceTree& pieces) {
+    std::string s;
+    auto piece = pieces.end();
+    while(piece != pieces.begin()) {
+        --piece;
+        s.insert(0, *piece);
+    }
+
+    return s;
+}
+
+TEST_CASE("Assign") {
+    PieceTree pieces;
+
+    SECTION("Single Piece") {
+        pieces.assign("int a = 0;"sv);
+
+        REQUIRE(pieces.size() == 1);
+        REQUIRE(pieces.length() == 10);
+        REQUIRE(Contents(pieces) == "int a = 0;");
+    }
+
+    SECTION("Multiple Pieces") {
+        std::vector<std::string_view> input = {"int"sv, ""sv, " a"sv, " = "sv, "0;"sv};
+        pieces.assign(input.begin(), input.end());
+
+        // The empty piece is skipped
+        REQUIRE(pieces.size() == 4);
+        REQUIRE(pieces.length() == 10);
+        REQUIRE(Contents(pieces) == "int a = 0;");
+        REQUIRE(ContentsBackwards(pieces) == "int a = 0;");
+    }
+
+    SECTION("Empty") {
+        pieces.assign(""sv);
+
+        REQUIRE(pieces.empty());
+        REQUIRE(pieces.begin() == pieces.end());
+    }
+}
+
+TEST_CASE("Find") {
+    std::vector<std::string_view> input = {"int"sv, " a"sv, " = "sv, "0;"sv};
+    PieceTree pieces;
+    pieces.assign(input.begin(), input.end());
+
+    PieceTree::Location start = pieces.find(0);
+    REQUIRE(*start.piece == "int");
+    REQUIRE(start.offset == 0);
+
+    PieceTree::Location middle = pieces.find(6);
+    REQUIRE(*middle.piece == " = ");
+    REQUIRE(middle.offset == 1);
+
+    PieceTree::Location last = pieces.find(9);
+    REQUIRE(*last.piece == "0;");
+    REQUIRE(last.offset == 1);
+
+    PieceTree::Location end = pieces.find(10);
+    REQUIRE(end.piece == pieces.end());
+}
+
+TEST_CASE("Insert") {
+    PieceTree pieces;
+    pieces.assign("int a;"sv);
+
+    SECTION("Start") {
+        pieces.insert(0, "const "sv);
+        REQUIRE(Contents(pieces) == "const int a;");
+    }
+
+    SECTION("Middle") {
+        pieces.insert(5, " = 0"sv);
+        REQUIRE(Contents(pieces) == "int a = 0;");
+        REQUIRE(pieces.size() == 3);
+    }
+
+    SECTION("End") {
+        pieces.insert(6, "\n"sv);
+        REQUIRE(Contents(pieces) == "int a;\n");
+        REQUIRE(pieces.size() == 2);
+    }
+
+    SECTION("Empty") {
+        pieces.insert(3, ""sv);
+        REQUIRE(pieces.size() == 1);
+    }
+}
+
+TEST_CASE("Erase") {
+    std::vector<std::string_view> input = {"int"sv, " a"sv, " = "sv, "0;"sv};
+    PieceTree pieces;
+    pieces.assign(input.begin(), input.end());
+
+    SECTION("Within A Piece") {
+        pieces.erase(1, 1);
+        REQUIRE(Contents(pieces) == "it a = 0;");
+    }
+
+    SECTION("Across Pieces") {
+        pieces.erase(5, 4);
+        REQUIRE(Contents(pieces) == "int a;");
+        REQUIRE(ContentsBackwards(pieces) == "int a;");
+    }
+
+    SECTION("Everything") {
+        pieces.erase(0, 10);
+        REQUIRE(pieces.empty());
+        REQUIRE(pieces.length() == 0);
+    }
+}
+
+TEST_CASE("Many Edits") {
+    std::string source = "abcdefghijklmnopqrstuvwxyz";
+    std::string expected;
+    PieceTree pieces;
+
+    // Build the alphabet up backwards one letter at a time at the start, then remove every other letter.
+    for(size_t i = source.size(); i > 0; i--) {
+        pieces.insert(0, std::string_view(source).substr(i - 1, 1));
+    }
+    REQUIRE(Contents(pieces) == source);
+
+    for(uint32_t i = 0; i < 13; i++) {
+        pieces.erase(i, 1);
+    }
+
+    REQUIRE(Contents(pieces) == "bdfhjlnprtvxz");
+    REQUIRE(ContentsBackwards(pieces) == "bdfhjlnprtvxz");
+    REQUIRE(pieces.size() == 13);
+}
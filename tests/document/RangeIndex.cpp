@@ -0,0 +1,117 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <tree-sitter-format/document/RangeIndex.h>
+
+using namespace tree_sitter_format;
+
+Position At(uint32_t column) {
+    return Position {
+        .location = TSPoint {
+            .row = 0,
+            .column = column,
+        },
+        .byteOffset = column,
+    };
+}
+
+Range Between(uint32_t start, uint32_t end) {
+    return Range::Between(At(start), At(end));
+}
+
+// The linear scans the index replaces, to check it against
+bool OverlapsByScan(const RangeIndex& index, const Range& range) {
+    for(const Range& r : index) {
+        if (r.start >= range.end) {
+            break;
+        }
+
+        if (r.end > range.start) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ContainsEndPointOfByScan(const RangeIndex& index, const Range& range) {
+    for(const Range& r : index) {
+        if (r.start >= range.end) {
+            break;
+        }
+
+        if ((r.start <= range.start && r.end > range.start) || (r.start < range.end && r.end >= range.end)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ContainsByScan(const RangeIndex& index, const Position& position) {
+    for(const Range& r : index) {
+        if (r.start > position) {
+            break;
+        }
+
+        if (r.end > position) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+TEST_CASE("Queries") {
+    RangeIndex index;
+    index.push_back(Between(2, 4));
+    index.push_back(Between(6, 7));
+    index.push_back(Between(10, 15));
+
+    SECTION("Contains") {
+        REQUIRE_FALSE(index.contains(At(1)));
+        REQUIRE(index.contains(At(2)));
+        REQUIRE(index.contains(At(3)));
+        REQUIRE_FALSE(index.contains(At(4)));
+        REQUIRE(index.contains(At(14)));
+        REQUIRE_FALSE(index.contains(At(15)));
+    }
+
+    SECTION("Overlaps") {
+        REQUIRE(index.overlaps(Between(0, 3)));
+        REQUIRE_FALSE(index.overlaps(Between(4, 6)));
+        REQUIRE(index.overlaps(Between(5, 20)));
+    }
+
+    SECTION("Contains End Point") {
+        REQUIRE(index.containsEndPointOf(Between(3, 5)));
+        REQUIRE(index.containsEndPointOf(Between(8, 15)));
+        REQUIRE_FALSE(index.containsEndPointOf(Between(5, 8)));
+    }
+
+    SECTION("Matches Scanning") {
+        for(uint32_t start = 0; start < 18; start++) {
+            REQUIRE(index.contains(At(start)) == ContainsByScan(index, At(start)));
+
+            for(uint32_t end = start; end < 18; end++) {
+                Range range = Between(start, end);
+                REQUIRE(index.overlaps(range) == OverlapsByScan(index, range));
+                REQUIRE(index.containsEndPointOf(range) == ContainsEndPointOfByScan(index, range));
+            }
+        }
+    }
+
+    SECTION("Cursor") {
+        RangeIndex::Cursor cursor = index.cursor();
+
+        // In order, then going backwards
+        for(uint32_t position = 0; position < 18; position++) {
+            REQUIRE(cursor.contains(At(position)) == ContainsByScan(index, At(position)));
+            REQUIRE(cursor.overlaps(Between(position, position + 2)) == OverlapsByScan(index, Between(position, position + 2)));
+        }
+
+        for(uint32_t position = 18; position > 0; position--) {
+            REQUIRE(cursor.contains(At(position - 1)) == ContainsByScan(index, At(position - 1)));
+            REQUIRE(cursor.containsEndPointOf(Between(position - 1, position)) == ContainsEndPointOfByScan(index, Between(position - 1, position)));
+        }
+    }
+}
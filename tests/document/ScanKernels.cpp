@@ -0,0 +1,204 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <tree-sitter-format/document/ScanKernels.h>
+
+#include <string>
+
+using namespace tree_sitter_format;
+using namespace std::literals::string_view_literals;
+
+TEST_CASE("Find Line Break Or Escape") {
+    SECTION("Short") {
+        REQUIRE(FindLineBreakOrEscape(""sv) == 0);
+        REQUIRE(FindLineBreakOrEscape("abc"sv) == 3);
+        REQUIRE(FindLineBreakOrEscape("ab\ncd"sv) == 2);
+        REQUIRE(FindLineBreakOrEscape("a\\"sv) == 1);
+        REQUIRE(FindLineBreakOrEscape("\r\n"sv) == 0);
+    }
+
+    SECTION("Every Position") {
+        // Long enough to go through the 32 and 16 byte blocks and the loop after them
+        for (char special : "\r\n\\"sv) {
+            for (size_t position = 0; position < 100; position++) {
+                std::string text(100, 'x');
+                text[position] = special;
+
+                REQUIRE(FindLineBreakOrEscape(text) == position);
+                REQUIRE(FindLineBreakOrEscape(std::string_view(text).substr(0, position)) == position);
+            }
+        }
+    }
+
+    SECTION("First Of Several") {
+        std::string text = std::string(40, ' ') + "\\" + std::string(10, ' ') + "\n";
+        REQUIRE(FindLineBreakOrEscape(text) == 40);
+    }
+}
+
+TEST_CASE("Find Non Ascii Or Line Feed") {
+    SECTION("Short") {
+        REQUIRE(FindNonAsciiOrLineFeed(""sv) == 0);
+        REQUIRE(FindNonAsciiOrLineFeed("a\\\r b"sv) == 5);
+        REQUIRE(FindNonAsciiOrLineFeed("ab\ncd"sv) == 2);
+        REQUIRE(FindNonAsciiOrLineFeed("h\xC3\xA9llo"sv) == 1);
+    }
+
+    SECTION("Every Position") {
+        for (char special : "\n\x80\xC3\xFF"sv) {
+            for (size_t position = 0; position < 100; position++) {
+                std::string text(100, 'x');
+                text[position] = special;
+
+                REQUIRE(FindNonAsciiOrLineFeed(text) == position);
+                REQUIRE(FindNonAsciiOrLineFeed(std::string_view(text).substr(0, position)) == position);
+            }
+        }
+    }
+}
+
+TEST_CASE("Count Lead Bytes") {
+    SECTION("Short") {
+        REQUIRE(CountLeadBytes(""sv) == 0);
+        REQUIRE(CountLeadBytes("abc"sv) == 3);
+        REQUIRE(CountLeadBytes("h\xC3\xA9llo"sv) == 5);
+        REQUIRE(CountLeadBytes("\xE2\x82\xAC\xF0\x9F\x98\x80"sv) == 2);
+        REQUIRE(CountLeadBytes("\x80\xBF"sv) == 0);
+    }
+
+    SECTION("Every Length") {
+        std::string text;
+        for (int i = 0; i < 30; i++) {
+            text += "a\xC3\xA9\xE2\x82\xAC\xFF";
+        }
+
+        for (size_t length = 0; length <= text.size(); length++) {
+            uint32_t expected = 0;
+            for (size_t i = 0; i < length; i++) {
+                if ((text[i] & 0b11000000) != 0b10000000) {
+                    expected++;
+                }
+            }
+
+            REQUIRE(CountLeadBytes(std::string_view(text).substr(0, length)) == expected);
+        }
+    }
+}
+
+// Decodes a sequence at a time, unlike ValidateUtf8, to check it against
+std::optional<size_t> DecodedFirstInvalidByte(std::string_view bytes) {
+    constexpr uint32_t Smallest[] = {0, 0, 0x80, 0x800, 0x10000};
+
+    for (size_t i = 0; i < bytes.size();) {
+        unsigned char lead = static_cast<unsigned char>(bytes[i]);
+        size_t length = lead < 0x80 ? 1 : lead < 0xC0 ? 0 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : lead < 0xF8 ? 4 : 0;
+        if (length == 0 || i + length > bytes.size()) {
+            return i;
+        }
+
+        uint32_t codePoint = length == 1 ? lead : lead & (0x7F >> length);
+        for (size_t j = 1; j < length; j++) {
+            unsigned char continuation = static_cast<unsigned char>(bytes[i + j]);
+            if ((continuation & 0xC0) != 0x80) {
+                return i;
+            }
+
+            codePoint = codePoint << 6 | (continuation & 0x3F);
+        }
+
+        if (codePoint < Smallest[length] || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+            return i;
+        }
+
+        i += length;
+    }
+
+    return std::nullopt;
+}
+
+TEST_CASE("Validate UTF-8") {
+    auto firstInvalidByte = [](std::string_view bytes) {
+        return ValidateUtf8(bytes).firstInvalidByte;
+    };
+
+    SECTION("ASCII") {
+        REQUIRE(ValidateUtf8(""sv).isAscii);
+        REQUIRE(ValidateUtf8(std::string(100, 'x')).isAscii);
+        REQUIRE(!firstInvalidByte(std::string(100, 'x')).has_value());
+    }
+
+    SECTION("Well Formed") {
+        std::string_view text = "h\xC3\xA9llo \xE2\x82\xAC \xF0\x9F\x98\x80 \xED\x9F\xBF \xF4\x8F\xBF\xBF"sv;
+
+        Utf8Validation validation = ValidateUtf8(text);
+        REQUIRE(!validation.firstInvalidByte.has_value());
+        REQUIRE(!validation.isAscii);
+    }
+
+    SECTION("Ill Formed") {
+        // Continuation byte without a lead byte
+        REQUIRE(firstInvalidByte("ab\x80"sv) == 2);
+        // Overlong encodings
+        REQUIRE(firstInvalidByte("\xC0\xAF"sv) == 0);
+        REQUIRE(firstInvalidByte("\xE0\x80\xAF"sv) == 0);
+        REQUIRE(firstInvalidByte("\xF0\x80\x80\xAF"sv) == 0);
+        // Surrogate
+        REQUIRE(firstInvalidByte("a\xED\xA0\x80"sv) == 1);
+        // Past U+10FFFF
+        REQUIRE(firstInvalidByte("\xF4\x90\x80\x80"sv) == 0);
+        REQUIRE(firstInvalidByte("\xF5\x80\x80\x80"sv) == 0);
+        // Truncated
+        REQUIRE(firstInvalidByte("abc\xE2\x82"sv) == 3);
+        REQUIRE(firstInvalidByte("\xE2\x82x"sv) == 0);
+    }
+
+    SECTION("Every Position") {
+        // Goes through the ASCII blocks and the sequence at a time checks
+        for (size_t position = 0; position < 100; position++) {
+            std::string text(100, 'x');
+            text[position] = '\xFF';
+
+            REQUIRE(firstInvalidByte(text) == position);
+
+            std::string valid(100, 'x');
+            valid.insert(position, "\xE2\x82\xAC");
+            REQUIRE(!firstInvalidByte(valid).has_value());
+        }
+    }
+
+    SECTION("Every Lead Byte Across A Block Boundary") {
+        // The bytes around the ones that decide whether a sequence is well formed
+        constexpr unsigned char SecondBytes[] = {0x00, 0x41, 0x7F, 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0, 0xC2, 0xE0, 0xF0, 0xFF};
+        constexpr unsigned char LaterBytes[] = {0x41, 0x80, 0xBF, 0xC0};
+
+        // Text that isn't ASCII around it, so no block is skipped
+        std::string before;
+        for (size_t position = 26; position < 36; position++) {
+            before.clear();
+            for (size_t i = 0; i + 1 < position; i += 2) {
+                before += "\xC3\xA9";
+            }
+            if (before.size() < position) {
+                before += 'a';
+            }
+
+            for (unsigned lead = 0x80; lead <= 0xFF; lead++) {
+                for (unsigned char second : SecondBytes) {
+                    for (unsigned char third : LaterBytes) {
+                        for (unsigned char fourth : LaterBytes) {
+                            std::string text = before;
+                            text += char(lead);
+                            text += char(second);
+                            text += char(third);
+                            text += char(fourth);
+                            text += "\xE2\x82\xAC b \xC3\xA9 c \xF0\x9F\x98\x80 d \xE2\x82\xAC e \xC3\xA9 \xC3\xA9 f";
+
+                            Utf8Validation validation = ValidateUtf8(text);
+                            REQUIRE(validation.firstInvalidByte == DecodedFirstInvalidByte(text));
+                            REQUIRE(!validation.isAscii);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
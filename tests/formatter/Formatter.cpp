@@ -0,0 +1,236 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <tree-sitter-format/Formatter.h>
+#include <tree-sitter-format/ThreadPool.h>
+#include <tree-sitter-format/style/Style.h>
+#include <tree-sitter-format/traversers/BracketExistanceTraverser.h>
+#include <tree-sitter-format/traversers/IndentationTraverser.h>
+#include <tree-sitter-format/traversers/SpaceTraverser.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace tree_sitter_format;
+
+const std::vector<std::string> INPUTS = {
+R"(int a()
+{
+int x = 1+2;   
+if (x)
+return x  *  2;
+return 0;
+}
+)",
+R"(namespace n {
+struct s {
+int a : 3;
+int b:4;
+};
+}
+)",
+R"(void f(int i)
+{
+for (int j = 0;j < i;j++)
+{
+    // clang-format off
+  int   k=j;
+    // clang-format on
+while (i) i--;
+}
+}
+)",
+};
+
+Formatter IndentationAndSpacing() {
+    Formatter formatter;
+    formatter.addTraverser(std::make_unique<BracketExistanceTraverser>());
+    formatter.addTraverser(std::make_unique<IndentationTraverser>());
+    formatter.addTraverser(std::make_unique<SpaceTraverser>(), PassOrdering::WithPrevious);
+
+    return formatter;
+}
+
+// Replaces identifiers, to make edits that only work whole
+class RenameTraverser : public Traverser {
+private:
+    std::map<std::string, std::string> names;
+
+protected:
+    void visitLeaf(TSNode node, TraverserContext& context) override {
+        auto name = names.find(context.document.contentsAtAsString(Range::Of(node)));
+        if (name != names.end()) {
+            context.edits.push_back(DeleteEdit {.range = Range::Of(node)});
+            context.edits.push_back(InsertEdit {.position = Position::StartOf(node), .bytes = name->second});
+        }
+    }
+
+public:
+    RenameTraverser(std::map<std::string, std::string> names) : names(std::move(names)) {}
+};
+
+// Sets the whitespace before tokens, to make edits that only change whitespace
+class GapTraverser : public Traverser {
+private:
+    std::map<std::string, std::string> gaps;
+    Position previousEnd;
+
+protected:
+    void reset(const TraverserContext& context) override {
+        previousEnd = context.document.startPosition();
+    }
+
+    void visitLeaf(TSNode node, TraverserContext& context) override {
+        auto gap = gaps.find(context.document.contentsAtAsString(Range::Of(node)));
+        if (gap != gaps.end()) {
+            if (previousEnd.byteOffset < ts_node_start_byte(node)) {
+                context.edits.push_back(DeleteEdit {.range = Range::Between(previousEnd, Position::StartOf(node))});
+            }
+
+            if (!gap->second.empty()) {
+                context.edits.push_back(InsertEdit {.position = Position::StartOf(node), .bytes = gap->second});
+            }
+        }
+
+        previousEnd = Position::EndOf(node);
+    }
+
+public:
+    GapTraverser(std::map<std::string, std::string> gaps) : gaps(std::move(gaps)) {}
+};
+
+// Cancels formatting from the first leaf it visits, and counts the leaves it visits
+class CancellingTraverser : public Traverser {
+private:
+    std::atomic_size_t& flag;
+
+protected:
+    void visitLeaf(TSNode, TraverserContext&) override {
+        flag = 1;
+        leaves++;
+    }
+
+public:
+    uint32_t leaves = 0;
+
+    CancellingTraverser(std::atomic_size_t& flag) : flag(flag) {}
+};
+
+TEST_CASE("Fused Passes") {
+    Style style;
+
+    Formatter separate;
+    separate.addTraverser(std::make_unique<IndentationTraverser>());
+    separate.addTraverser(std::make_unique<SpaceTraverser>());
+
+    Formatter fused;
+    fused.addTraverser(std::make_unique<IndentationTraverser>());
+    fused.addTraverser(std::make_unique<SpaceTraverser>(), PassOrdering::WithPrevious);
+
+    for (const std::string& input : INPUTS) {
+        Document separateDocument(input);
+        REQUIRE(separate.format(style, separateDocument) == FormatResult::Formatted);
+
+        Document fusedDocument(input);
+        REQUIRE(fused.format(style, fusedDocument) == FormatResult::Formatted);
+
+        REQUIRE(fusedDocument.toString() == separateDocument.toString());
+    }
+}
+
+TEST_CASE("Fused Passes With Conflicting Edits") {
+    Style style;
+
+    Document document(std::string("int x = w;\n"));
+    document.collectParseStatistics();
+
+    Formatter formatter;
+
+    SECTION("Earlier Traverser Wins") {
+        formatter.addTraverser(std::make_unique<RenameTraverser>(std::map<std::string, std::string> {{"x", "y"}}));
+        formatter.addTraverser(std::make_unique<RenameTraverser>(std::map<std::string, std::string> {{"x", "z"}, {"w", "v"}}), PassOrdering::WithPrevious);
+
+        REQUIRE(formatter.format(style, document) == FormatResult::Formatted);
+
+        // The second traverser's edits overlapped, so none of them were applied with the
+        // first's. It walked the tree again afterwards, when there was no x left to rename.
+        REQUIRE(document.toString() == "int y = v;\n");
+        REQUIRE(document.parseStatistics().value().reparses == 2);
+    }
+
+    SECTION("Higher Priority Wins") {
+        formatter.addTraverser(std::make_unique<RenameTraverser>(std::map<std::string, std::string> {{"x", "y"}}));
+        formatter.addTraverser(std::make_unique<RenameTraverser>(std::map<std::string, std::string> {{"x", "z"}, {"w", "v"}}), PassOrdering::WithPrevious, 1);
+
+        REQUIRE(formatter.format(style, document) == FormatResult::Formatted);
+
+        REQUIRE(document.toString() == "int z = v;\n");
+        REQUIRE(document.parseStatistics().value().reparses == 1);
+    }
+}
+
+TEST_CASE("Fused Passes With Conflicting Whitespace Edits") {
+    Style style;
+
+    Document document(std::string("int x=w ;\n"));
+    document.collectParseStatistics();
+
+    Formatter formatter;
+    formatter.addTraverser(std::make_unique<GapTraverser>(std::map<std::string, std::string> {{"=", " "}}));
+    formatter.addTraverser(std::make_unique<GapTraverser>(std::map<std::string, std::string> {{"=", " "}, {";", ""}}), PassOrdering::WithPrevious);
+
+    REQUIRE(formatter.format(style, document) == FormatResult::Formatted);
+
+    // Only the second traverser's space before the = conflicted, so the space it took out
+    // before the ; was applied with the first's edits. Walking the tree again changed nothing.
+    REQUIRE(document.toString() == "int x =w;\n");
+    const ParseStatistics& statistics = document.parseStatistics().value();
+    REQUIRE(statistics.reparses + statistics.shifts == 1);
+}
+
+TEST_CASE("Formatting On A Thread Pool") {
+    Style style;
+
+    Formatter serial = IndentationAndSpacing();
+
+    ThreadPool pool(4);
+    Formatter parallel = IndentationAndSpacing();
+    parallel.setThreadPool(&pool);
+
+    for (const std::string& input : INPUTS) {
+        Document serialDocument(input);
+        REQUIRE(serial.format(style, serialDocument) == FormatResult::Formatted);
+
+        Document parallelDocument(input);
+        REQUIRE(parallel.format(style, parallelDocument) == FormatResult::Formatted);
+
+        REQUIRE(parallelDocument.toString() == serialDocument.toString());
+    }
+}
+
+TEST_CASE("Stopping Part Way Through A Walk") {
+    Style style;
+
+    std::string input;
+    for (int i = 0; i < 1000; i++) {
+        input += "int x = w;\n";
+    }
+
+    Document document(input);
+
+    std::atomic_size_t flag = 0;
+    auto cancelling = std::make_unique<CancellingTraverser>(flag);
+    CancellingTraverser& traverser = *cancelling;
+
+    Formatter formatter;
+    formatter.addTraverser(std::move(cancelling));
+    formatter.addTraverser(std::make_unique<RenameTraverser>(std::map<std::string, std::string> {{"x", "y"}}), PassOrdering::WithPrevious);
+
+    REQUIRE(formatter.format(style, document, FormatLimits {.cancellationFlag = &flag}) == FormatResult::Cancelled);
+
+    // The walk stopped at the next check, well before the 5000 leaves, and none of the
+    // renames it had made so far were applied
+    REQUIRE(traverser.leaves < 5000);
+    REQUIRE(document.toString() == input);
+}
@@ -0,0 +1,59 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <tree-sitter-format/ThreadPool.h>
+
+#include <atomic>
+#include <vector>
+
+using namespace tree_sitter_format;
+
+TEST_CASE("Thread Pool") {
+    ThreadPool pool(3);
+    REQUIRE(pool.size() == 3);
+
+    SECTION("Every Index Once") {
+        // Many more tasks than threads, so each thread claims several of them
+        std::vector<std::atomic_int> calls(1000);
+        pool.forEach(calls.size(), [&](size_t i) {
+            calls[i]++;
+        });
+
+        for (const std::atomic_int& count : calls) {
+            REQUIRE(count == 1);
+        }
+    }
+
+    SECTION("No Tasks") {
+        std::atomic_int calls = 0;
+        pool.forEach(0, [&](size_t) {
+            calls++;
+        });
+
+        REQUIRE(calls == 0);
+    }
+
+    SECTION("Reused") {
+        for (size_t count = 1; count <= 64; count++) {
+            std::vector<std::atomic_int> calls(count);
+            pool.forEach(count, [&](size_t i) {
+                calls[i]++;
+            });
+
+            for (const std::atomic_int& called : calls) {
+                REQUIRE(called == 1);
+            }
+        }
+    }
+}
+
+TEST_CASE("Thread Pool Without Threads") {
+    // The calling thread does all of the work itself
+    ThreadPool pool(0);
+
+    std::vector<int> calls(10);
+    pool.forEach(calls.size(), [&](size_t i) {
+        calls[i]++;
+    });
+
+    REQUIRE(calls == std::vector<int>(10, 1));
+}
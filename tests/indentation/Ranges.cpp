@@ -0,0 +1,200 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <tree-sitter-format/Formatter.h>
+#include <tree-sitter-format/style/Style.h>
+#include <tree-sitter-format/traversers/IndentationTraverser.h>
+#include <tree-sitter-format/traversers/SpaceTraverser.h>
+
+#include <vector>
+
+using namespace tree_sitter_format;
+
+const std::string INPUT = R"(int a()
+{
+int x;
+}
+int b()
+{
+int y;
+}
+)";
+
+const std::string FIRST_LINE_FORMATTED = R"(int a()
+{
+    int x;
+}
+int b()
+{
+int y;
+}
+)";
+
+const std::string BOTH_LINES_FORMATTED = R"(int a()
+{
+    int x;
+}
+int b()
+{
+    int y;
+}
+)";
+
+TEST_CASE("Formatting Ranges") {
+    Formatter formatter;
+    formatter.addTraverser(std::make_unique<IndentationTraverser>());
+
+    Style style;
+    style.indentation.whitespace = Style::IndentationWhitespace::Spaces;
+    style.indentation.functionDefinitions = Style::Indentation::BodyIndented;
+
+    Document document(INPUT);
+
+    SECTION("One Line") {
+        std::vector<Range> ranges {document.lineRange(2)};
+        formatter.format(style, document, ranges);
+
+        REQUIRE(document.toString() == FIRST_LINE_FORMATTED);
+    }
+
+    SECTION("Several Lines") {
+        std::vector<Range> ranges {document.lineRange(6), document.lineRange(2)};
+        formatter.format(style, document, ranges);
+
+        REQUIRE(document.toString() == BOTH_LINES_FORMATTED);
+    }
+
+    SECTION("No Ranges") {
+        formatter.format(style, document, std::vector<Range>());
+
+        REQUIRE(document.toString() == INPUT);
+    }
+}
+
+const std::string SPLIT_EXPRESSION = R"(int a()
+{
+int x = 1 +
+2;
+int y = 3+4;
+}
+)";
+
+const std::string SPLIT_EXPRESSION_FORMATTED = R"(int a()
+{
+int x = 1 +
+2;
+int y = 3 + 4;
+}
+)";
+
+TEST_CASE("Formatting Ranges That Start After A Respaced Token") {
+    Formatter formatter;
+    formatter.addTraverser(std::make_unique<SpaceTraverser>());
+
+    Style style;
+    Document document(SPLIT_EXPRESSION);
+
+    // The space after the + would replace the new line before the 2, which isn't in the range
+    std::vector<Range> ranges {Range::Between(document.lineRange(3).start, document.lineRange(4).end)};
+    formatter.format(style, document, ranges);
+
+    REQUIRE(document.toString() == SPLIT_EXPRESSION_FORMATTED);
+
+    ranges = {Range::Between(document.lineRange(3).start, document.lineRange(4).end)};
+    formatter.format(style, document, ranges);
+
+    REQUIRE(document.toString() == SPLIT_EXPRESSION_FORMATTED);
+}
+
+const std::string STATEMENTS = R"(int a()
+{
+int x; int y;
+int z;
+if (x)
+{
+int v;
+int w;
+}
+}
+)";
+
+TEST_CASE("Formatting Ranges Inside Blocks") {
+    Formatter formatter;
+    formatter.addTraverser(std::make_unique<IndentationTraverser>());
+
+    Style style;
+    style.indentation.whitespace = Style::IndentationWhitespace::Spaces;
+    style.indentation.functionDefinitions = Style::Indentation::BodyIndented;
+    style.indentation.ifStatements = Style::Indentation::BodyIndented;
+
+    Document document(STATEMENTS);
+
+    SECTION("Starting In The Middle Of A Line") {
+        // The line's first token isn't in the range, so the line isn't reindented
+        Position start = document.positionAt(uint32_t(STATEMENTS.find("int y")));
+        std::vector<Range> ranges {Range::Between(start, document.lineRange(3).end)};
+        formatter.format(style, document, ranges);
+
+        REQUIRE(document.toString() == R"(int a()
+{
+int x; int y;
+    int z;
+if (x)
+{
+int v;
+int w;
+}
+}
+)");
+    }
+
+    SECTION("Starting At A Later Statement") {
+        std::vector<Range> ranges {document.lineRange(3)};
+        formatter.format(style, document, ranges);
+
+        REQUIRE(document.toString() == R"(int a()
+{
+int x; int y;
+    int z;
+if (x)
+{
+int v;
+int w;
+}
+}
+)");
+    }
+
+    SECTION("Starting In A Nested Block") {
+        std::vector<Range> ranges {document.lineRange(7)};
+        formatter.format(style, document, ranges);
+
+        REQUIRE(document.toString() == R"(int a()
+{
+int x; int y;
+int z;
+if (x)
+{
+int v;
+        int w;
+}
+}
+)");
+    }
+
+    SECTION("Closing A Nested Block") {
+        std::vector<Range> ranges {Range::Between(document.lineRange(7).start, document.lineRange(8).end)};
+        formatter.format(style, document, ranges);
+
+        REQUIRE(document.toString() == R"(int a()
+{
+int x; int y;
+int z;
+if (x)
+{
+int v;
+        int w;
+    }
+}
+)");
+    }
+}
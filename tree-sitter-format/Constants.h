@@ -57,6 +57,10 @@ inline const TSSymbol BINARY_EXPRESSION = ts_language_symbol_for_name(tree_sitte
 
 inline const TSSymbol COMMENT = ts_language_symbol_for_name(tree_sitter_cpp(), "comment", 7, true);
 
+inline const TSSymbol STRING_LITERAL = ts_language_symbol_for_name(tree_sitter_cpp(), "string_literal", 14, true);
+inline const TSSymbol RAW_STRING_LITERAL = ts_language_symbol_for_name(tree_sitter_cpp(), "raw_string_literal", 18, true);
+inline const TSSymbol CHAR_LITERAL = ts_language_symbol_for_name(tree_sitter_cpp(), "char_literal", 12, true);
+
 inline const TSSymbol TRANSLATION_UNIT = ts_language_symbol_for_name(tree_sitter_cpp(), "translation_unit", 16, true);
 inline const TSSymbol ERROR = ts_language_symbol_for_name(tree_sitter_cpp(), "ERROR", 5, true);
 
@@ -1,16 +1,333 @@
 #include <tree-sitter-format/Formatter.h>
 
+#include <tree-sitter-format/document/EditMerger.h>
+
+#include <algorithm>
+#include <optional>
+#include <span>
+#include <utility>
+
+namespace {
+    using namespace tree_sitter_format;
+
+    bool IsCancelled(const std::atomic_size_t* flag) {
+        return flag != nullptr && flag->load() != 0;
+    }
+
+    bool IsWhitespace(std::string_view bytes) {
+        return bytes.find_first_not_of(" \t\r\n\f\v") == std::string_view::npos;
+    }
+
+    std::pair<uint32_t, uint32_t> EditedBytes(const Edit& edit) {
+        if (const DeleteEdit* d = std::get_if<DeleteEdit>(&edit)) {
+            return {d->range.start.byteOffset, d->range.end.byteOffset};
+        }
+
+        const InsertEdit& insert = std::get<InsertEdit>(edit);
+        return {insert.position.byteOffset, insert.position.byteOffset};
+    }
+
+    bool IsWithin(std::span<const Range> ranges, std::pair<uint32_t, uint32_t> bytes) {
+        auto range = std::ranges::lower_bound(ranges, bytes.second, {}, [](const Range& r) { return r.end.byteOffset; });
+        return range != ranges.end() && range->start.byteOffset <= bytes.first;
+    }
+
+    // Whether `insert` puts back what `remove` takes out, like the space that replaces the
+    // whitespace between two tokens. Neither means anything without the other.
+    bool IsReplacement(const Edit& remove, const Edit& insert) {
+        const DeleteEdit* d = std::get_if<DeleteEdit>(&remove);
+        const InsertEdit* i = std::get_if<InsertEdit>(&insert);
+        return d != nullptr && i != nullptr &&
+            (i->position.byteOffset == d->range.start.byteOffset || i->position.byteOffset == d->range.end.byteOffset);
+    }
+
+    bool ChangesOnlyWhitespace(const Edit& edit, const Document& document) {
+        if (const DeleteEdit* d = std::get_if<DeleteEdit>(&edit)) {
+            return IsWhitespace(document.contentsAtAsString(d->range));
+        }
+
+        return IsWhitespace(std::get<InsertEdit>(edit).bytes);
+    }
+
+    // Takes out the edits that aren't within `ranges`. A delete and the insert that replaces
+    // what it deleted are kept or taken out together. If any of the edits taken out changed
+    // more than whitespace, they could be one half of a change that only works whole, like a
+    // pair of brackets, so all of the edits are taken out instead.
+    void SuppressOutside(std::vector<Edit>& edits, std::span<const Range> ranges, const Document& document) {
+        bool onlyWhitespace = true;
+        std::vector<Edit> kept;
+
+        for (size_t i = 0; i < edits.size();) {
+            size_t count = i + 1 < edits.size() && IsReplacement(edits[i], edits[i + 1]) ? 2 : 1;
+            std::span<const Edit> unit(edits.data() + i, count);
+            i += count;
+
+            if (std::ranges::all_of(unit, [&](const Edit& edit) { return IsWithin(ranges, EditedBytes(edit)); })) {
+                kept.insert(kept.end(), unit.begin(), unit.end());
+                continue;
+            }
+
+            onlyWhitespace = onlyWhitespace && std::ranges::all_of(unit, [&](const Edit& edit) {
+                return ChangesOnlyWhitespace(edit, document);
+            });
+        }
+
+        if (!onlyWhitespace) {
+            kept.clear();
+        }
+
+        edits = std::move(kept);
+    }
+
+    // Adds one traverser's edits to `merger`, and returns whether all of them were added. The
+    // edits are split into units of edits that overlap or touch, which the document would join
+    // into one replacement. A unit that only changes whitespace stands on its own, so it is
+    // added even if another one conflicts, and the traverser doesn't have to walk the tree again
+    // for it. The units that change more than whitespace are added together, or not at all.
+    bool MergeEdits(EditMerger& merger, const std::vector<Edit>& edits, const Document& document) {
+        std::vector<size_t> order(edits.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+
+        std::ranges::sort(order, {}, [&](size_t i) { return EditedBytes(edits[i]); });
+
+        std::vector<size_t> unitOf(edits.size());
+        size_t units = 0;
+        uint32_t unitEnd = 0;
+        for (size_t i : order) {
+            auto [start, end] = EditedBytes(edits[i]);
+            if (units == 0 || start > unitEnd) {
+                units++;
+                unitEnd = end;
+            }
+
+            unitEnd = std::max(unitEnd, end);
+            unitOf[i] = units - 1;
+        }
+
+        // Each unit keeps its edits in the order they were made, so inserts at one position stay in order
+        std::vector<std::vector<Edit>> unitEdits(units);
+        std::vector<bool> onlyWhitespace(units, true);
+        for (size_t i = 0; i < edits.size(); i++) {
+            unitEdits[unitOf[i]].push_back(edits[i]);
+            onlyWhitespace[unitOf[i]] = onlyWhitespace[unitOf[i]] && ChangesOnlyWhitespace(edits[i], document);
+        }
+
+        bool allAdded = true;
+        std::vector<Edit> others;
+        for (size_t unit = 0; unit < units; unit++) {
+            if (onlyWhitespace[unit]) {
+                allAdded = merger.add(unitEdits[unit]) && allAdded;
+            } else {
+                others.insert(others.end(), unitEdits[unit].begin(), unitEdits[unit].end());
+            }
+        }
+
+        return (others.empty() || merger.add(others)) && allAdded;
+    }
+
+    // Walks the tree once for all of `traversers`, then applies the edits of each of them that
+    // don't conflict with the edits of the ones before it. Returns the traversers that had edits
+    // which weren't applied, or nothing if the walk was stopped or the reparse failed. When only
+    // `ranges` are being formatted, they are moved along with the edits.
+    std::optional<std::vector<Traverser*>> RunPass(std::span<Traverser* const> traversers, const Style& style, Document& document, ThreadPool* pool, std::vector<Range>& ranges, std::chrono::steady_clock::time_point deadline, const std::atomic_size_t* cancellationFlag) {
+        std::vector<TraverserContext> contexts;
+        contexts.reserve(traversers.size());
+
+        for (size_t i = 0; i < traversers.size(); i++) {
+            contexts.push_back(TraverserContext {
+                .document = document,
+                .style = style,
+                .ranges = ranges,
+                .deadline = deadline,
+                .cancellationFlag = cancellationFlag,
+            });
+        }
+
+        if (pool != nullptr && pool->size() > 0 && traversers.size() > 1) {
+            // The copies are made here rather than on the threads that use them, since making
+            // a copy takes a reference to the nodes of the tree it is copied from
+            std::vector<std::unique_ptr<TSTree, TSTreeDeleter>> trees;
+            trees.reserve(traversers.size());
+            for (size_t i = 0; i < traversers.size(); i++) {
+                trees.push_back(document.copyTree());
+            }
+
+            pool->forEach(traversers.size(), [&](size_t i) {
+                traversers[i]->traverse(ts_tree_root_node(trees[i].get()), contexts[i]);
+            });
+        } else {
+            Traverser::TraverseAll(traversers, contexts);
+        }
+
+        // A walk that was stopped only made some of its edits
+        if (std::ranges::any_of(contexts, [](const TraverserContext& context) { return context.stopped; })) {
+            return std::nullopt;
+        }
+
+        // Edits are merged in priority order, however the threads finished, so the result is
+        // the same as walking the traversers one at a time.
+        EditMerger merger;
+        std::vector<Traverser*> deferred;
+        for (size_t i = 0; i < traversers.size(); i++) {
+            if (!ranges.empty()) {
+                SuppressOutside(contexts[i].edits, ranges, document);
+            }
+
+            if (!MergeEdits(merger, contexts[i].edits, document)) {
+                deferred.push_back(traversers[i]);
+            }
+        }
+
+        std::vector<Edit> edits = merger.take();
+
+        // Every edit that will be applied is within the ranges, so inserts at either end of a
+        // range stay in it. The ranges are sorted and don't touch, so their ends are in order.
+        // The edits are sorted the way the document sorts them, which then leaves them as they are.
+        std::vector<RebasedOffset> offsets;
+        if (!ranges.empty()) {
+            std::ranges::stable_sort(edits);
+
+            offsets.reserve(2 * ranges.size());
+            for (const Range& range : ranges) {
+                offsets.push_back(RebasedOffset {.byteOffset = range.start.byteOffset, .insertsAfter = true});
+                offsets.push_back(RebasedOffset {.byteOffset = range.end.byteOffset, .insertsAfter = false});
+            }
+
+            RebaseOffsets(offsets, edits);
+        }
+
+        // The document takes over the buffers the inserted text was appended to, rather than
+        // copying the text out of them
+        std::vector<AddBuffer> texts;
+        texts.reserve(contexts.size());
+        for (TraverserContext& context : contexts) {
+            texts.push_back(std::move(context.text));
+        }
+
+        if (!document.applyEdits(std::move(edits), std::move(texts))) {
+            return std::nullopt;
+        }
+
+        for (size_t i = 0; i < ranges.size(); i++) {
+            ranges[i] = Range::Between(document.positionAt(offsets[2 * i].byteOffset), document.positionAt(offsets[2 * i + 1].byteOffset));
+        }
+
+        return deferred;
+    }
+}
+
 namespace tree_sitter_format {
 
-    void Formatter::addTraverser(std::unique_ptr<Traverser> traverser) {
-        traversers.push_back(std::move(traverser));
+    void Formatter::addTraverser(std::unique_ptr<Traverser> traverser, PassOrdering ordering, int priority) {
+        if (ordering == PassOrdering::AfterPrevious || passes.empty()) {
+            passes.emplace_back();
+        }
+
+        // Each pass is kept in priority order, with the earliest added first among equals
+        std::vector<PassTraverser>& pass = passes.back();
+        auto position = std::ranges::find_if(pass, [&](const PassTraverser& added) {
+            return added.priority < priority;
+        });
+
+        pass.insert(position, PassTraverser {
+            .traverser = std::move(traverser),
+            .priority = priority,
+        });
     }
 
-    void Formatter::format(const Style& style, Document& document) {
-        for (std::unique_ptr<Traverser>& traverser : traversers) {
-            std::vector<Edit> edits = traverser->traverse(document, style);
-            document.applyEdits(edits);
+    void Formatter::setThreadPool(ThreadPool* threadPool) {
+        pool = threadPool;
+    }
+
+    FormatResult Formatter::format(const Style& style, Document& document, const FormatLimits& limits) {
+        return formatWithin(style, document, {}, limits);
+    }
+
+    FormatResult Formatter::format(const Style& style, Document& document, std::span<const Range> ranges, const FormatLimits& limits) {
+        if (ranges.empty()) {
+            return document.isValidUtf8() ? FormatResult::Formatted : FormatResult::InvalidUtf8;
+        }
+
+        std::vector<Range> sorted(ranges.begin(), ranges.end());
+        std::ranges::sort(sorted, {}, [](const Range& range) { return range.start.byteOffset; });
+
+        // Ranges that overlap or touch are joined, so each node is checked against one range
+        size_t joined = 0;
+        for (size_t i = 1; i < sorted.size(); i++) {
+            if (sorted[i].start.byteOffset <= sorted[joined].end.byteOffset) {
+                if (sorted[i].end.byteOffset > sorted[joined].end.byteOffset) {
+                    sorted[joined].end = sorted[i].end;
+                }
+            } else {
+                sorted[++joined] = sorted[i];
+            }
+        }
+
+        sorted.resize(joined + 1);
+        return formatWithin(style, document, std::move(sorted), limits);
+    }
+
+    FormatResult Formatter::formatWithin(const Style& style, Document& document, std::vector<Range> ranges, const FormatLimits& limits) {
+        using Clock = std::chrono::steady_clock;
+        Clock::time_point deadline = limits.timeBudget.count() > 0 ? Clock::now() + limits.timeBudget : Clock::time_point::max();
+
+        if (!document.isValidUtf8()) {
+            return FormatResult::InvalidUtf8;
         }
+
+        FormatResult result = FormatResult::Formatted;
+        document.setCancellationFlag(limits.cancellationFlag);
+
+        for (size_t pass = 0; pass < passes.size() && result == FormatResult::Formatted; pass++) {
+            // Traversers whose edits overlapped the edits of a traverser with a higher priority
+            // walk the tree again, after the edits that were applied
+            std::vector<Traverser*> remaining;
+            for (const PassTraverser& added : passes[pass]) {
+                remaining.push_back(added.traverser.get());
+            }
+
+            while (!remaining.empty()) {
+                if (IsCancelled(limits.cancellationFlag)) {
+                    result = FormatResult::Cancelled;
+                    break;
+                }
+
+                // Each reparse gets whatever is left of the budget. It is rounded up, so a reparse
+                // that is stopped is always past the deadline.
+                if (limits.timeBudget.count() > 0) {
+                    auto remainingTime = std::chrono::ceil<std::chrono::microseconds>(deadline - Clock::now());
+                    if (remainingTime.count() <= 0) {
+                        result = FormatResult::TimedOut;
+                        break;
+                    }
+
+                    document.setParseTimeout(remainingTime);
+                }
+
+                // The walks check the deadline and the flag too, so a pass can stop part way
+                // through rather than only at a reparse
+                std::optional<std::vector<Traverser*>> deferred = RunPass(remaining, style, document, pool, ranges, deadline, limits.cancellationFlag);
+                if (!deferred.has_value()) {
+                    if (IsCancelled(limits.cancellationFlag)) {
+                        result = FormatResult::Cancelled;
+                    } else if (Clock::now() >= deadline) {
+                        result = FormatResult::TimedOut;
+                    } else {
+                        result = FormatResult::ParseFailed;
+                    }
+                    break;
+                }
+
+                remaining = std::move(deferred.value());
+            }
+        }
+
+        document.setParseTimeout(std::chrono::microseconds(0));
+        document.setCancellationFlag(nullptr);
+
+        return result;
     }
 
 }
@@ -1,18 +1,87 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <span>
+#include <vector>
 
+#include <tree-sitter-format/ThreadPool.h>
 #include <tree-sitter-format/traversers/Traverser.h>
 
 namespace tree_sitter_format {
 
+struct FormatLimits {
+    // How long formatting one document may take, including every walk of the tree and every
+    // reparse. Zero means no limit.
+    std::chrono::microseconds timeBudget {0};
+
+    // Formatting stops when `*cancellationFlag` becomes non-zero. See Document::setCancellationFlag.
+    const std::atomic_size_t* cancellationFlag = nullptr;
+};
+
+enum class FormatResult {
+    Formatted,
+    TimedOut,
+    Cancelled,
+    InvalidUtf8,
+
+    // A reparse failed without being stopped. The document has no tree, so it can't be
+    // formatted any further.
+    ParseFailed,
+};
+
+// How a traverser's pass relates to the pass of the traverser added before it
+enum class PassOrdering {
+    // The traverser reads what earlier traversers changed, so it walks the tree after their
+    // edits have been applied.
+    AfterPrevious,
+
+    // The traverser doesn't read what the traverser before it changes, so they walk the tree
+    // together and their edits are applied with one reparse. If their edits conflict, the
+    // traverser with the lower priority walks the tree again after the rest are applied. Only
+    // its edits that change more than whitespace are held back with the ones that conflict.
+    // Edits that only touch, like two traversers trimming either side of a space, don't conflict.
+    WithPrevious,
+};
+
 class Formatter {
 private:
-    std::vector<std::unique_ptr<Traverser>> traversers;
+    struct PassTraverser {
+        std::unique_ptr<Traverser> traverser;
+        int priority;
+    };
+
+    // Each pass is one walk of the tree followed by one reparse
+    std::vector<std::vector<PassTraverser>> passes;
+
+    ThreadPool* pool = nullptr;
+
+    // Empty ranges means the whole document
+    FormatResult formatWithin(const Style& style, Document& document, std::vector<Range> ranges, const FormatLimits& limits);
 
 public:
-    void addTraverser(std::unique_ptr<Traverser> traverser);
-    void format(const Style& style, Document& document);
+    // A traverser's priority decides whose edits are applied when the edits of traversers in
+    // the same pass conflict. Higher priorities win, and ties go to the traverser added first.
+    void addTraverser(std::unique_ptr<Traverser> traverser, PassOrdering ordering = PassOrdering::AfterPrevious, int priority = 0);
+
+    // With a pool, the traversers in each pass walk the tree at the same time on the pool's
+    // threads, each with its own copy of the tree, instead of together on one thread. Their
+    // edits are merged the same way either way. Passing nullptr goes back to one thread.
+    void setThreadPool(ThreadPool* threadPool);
+
+    // If formatting runs out of time or is cancelled, it stops between passes, or undoes the
+    // pass whose reparse was stopped. The document keeps the passes that finished,
+    // so to leave a file unchanged, don't write the document back to it. A document that isn't
+    // valid UTF-8 isn't formatted at all.
+    FormatResult format(const Style& style, Document& document, const FormatLimits& limits = {});
+
+    // Formats only the parts of the document within `ranges`, like a selection or the lines a
+    // diff changed. Lines can be given with Document::lineRange. Only the subtrees that touch
+    // the ranges are walked, so the time taken depends on the size of the ranges rather than
+    // of the document. Edits outside the ranges are left out. If a traverser made any there
+    // that change more than whitespace, none of its edits in that pass are applied.
+    FormatResult format(const Style& style, Document& document, std::span<const Range> ranges, const FormatLimits& limits = {});
 };
 
 }
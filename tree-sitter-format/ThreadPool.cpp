@@ -0,0 +1,81 @@
+#include <tree-sitter-format/ThreadPool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <latch>
+#include <memory>
+
+namespace tree_sitter_format {
+
+    ThreadPool::ThreadPool(size_t threadCount) {
+        threads.reserve(threadCount);
+        for (size_t i = 0; i < threadCount; i++) {
+            threads.emplace_back([this]() { work(); });
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+
+        available.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    void ThreadPool::work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex);
+                available.wait(lock, [&]() { return stopping || !queue.empty(); });
+                if (queue.empty()) {
+                    return;
+                }
+
+                task = std::move(queue.front());
+                queue.pop_front();
+            }
+
+            task();
+        }
+    }
+
+    void ThreadPool::forEach(size_t count, const std::function<void(size_t)>& task) {
+        if (count == 0) {
+            return;
+        }
+
+        // Indices are claimed from a shared counter rather than handed out up front, so a
+        // thread that finishes a short task moves on to the next one.
+        std::atomic_size_t next = 0;
+        auto claim = [&]() {
+            for (size_t i = next++; i < count; i = next++) {
+                task(i);
+            }
+        };
+
+        // The latch is shared with the helpers, since one of them can still be inside
+        // count_down after the wait below has returned
+        size_t helpers = std::min(threads.size(), count - 1);
+        auto finished = std::make_shared<std::latch>(std::ptrdiff_t(helpers + 1));
+        {
+            std::lock_guard lock(mutex);
+            for (size_t i = 0; i < helpers; i++) {
+                queue.push_back([&claim, finished]() {
+                    claim();
+                    finished->count_down();
+                });
+            }
+        }
+
+        available.notify_all();
+
+        claim();
+        finished->arrive_and_wait();
+    }
+
+}
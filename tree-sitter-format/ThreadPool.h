@@ -0,0 +1,40 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tree_sitter_format {
+
+// A fixed set of threads that tasks are handed to, so formatting many passes doesn't start
+// and join threads for each one.
+class ThreadPool {
+private:
+    std::mutex mutex;
+    std::condition_variable available;
+    std::deque<std::function<void()>> queue;
+    bool stopping = false;
+
+    std::vector<std::thread> threads;
+
+    void work();
+
+public:
+    explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return threads.size(); }
+
+    // Calls `task` with each index from zero to `count`, spread over the pool's threads, and
+    // returns once every call has finished. The calling thread takes part rather than wait.
+    void forEach(size_t count, const std::function<void(size_t)>& task);
+};
+
+}
@@ -3,7 +3,6 @@
 #include <tree-sitter-format/Constants.h>
 
 #include <array>
-#include <unordered_map>
 #include <assert.h>
 #include <deque>
 
@@ -202,16 +201,6 @@ std::string_view ChildFieldName(TSNode node, uint32_t childIndex) {
     return false;
 }
 
-[[nodiscard]] std::string_view GetSpaces(uint32_t count) {
-    static std::unordered_map<uint32_t, std::string> spaces;
-
-    if (!spaces.contains(count)) {
-        spaces[count] = std::string(count, ' ');
-    }
-
-    return spaces[count];
-}
-
 
 [[nodiscard]] bool IsWhitespace(char32_t character) {
     return character == ' ' || character == '\t' || character == '\n' || character == '\r';
@@ -30,8 +30,6 @@ namespace tree_sitter_format {
 
 [[nodiscard]] bool IsBitfieldDeclaration(TSNode node);
 
-[[nodiscard]] std::string_view GetSpaces(uint32_t count);
-
 
 
 [[nodiscard]] bool IsWhitespace(char32_t character);
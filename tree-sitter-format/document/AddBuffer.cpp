@@ -0,0 +1,74 @@
+#include <tree-sitter-format/document/AddBuffer.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace tree_sitter_format {
+
+    char* AddBuffer::reserve(size_t count) {
+        if (blocks.empty() || blocks.back().capacity - used < count) {
+            // Whatever is left in the current block is abandoned. Appends are usually small,
+            // so this wastes little, and anything bigger than a block gets a block of its own.
+            size_t capacity = std::max(BlockSize, count);
+            blocks.push_back(Block {
+                .bytes = std::make_unique_for_overwrite<char[]>(capacity),
+                .capacity = capacity,
+            });
+            used = 0;
+        }
+
+        char* start = blocks.back().bytes.get() + used;
+        used += count;
+
+        return start;
+    }
+
+    std::string_view AddBuffer::append(std::string_view bytes) {
+        if (bytes.empty()) {
+            return std::string_view();
+        }
+
+        char* start = reserve(bytes.size());
+        std::memcpy(start, bytes.data(), bytes.size());
+
+        return std::string_view(start, bytes.size());
+    }
+
+    std::string_view AddBuffer::appendRepeated(char character, size_t count) {
+        if (count == 0) {
+            return std::string_view();
+        }
+
+        char* start = reserve(count);
+        std::memset(start, character, count);
+
+        return std::string_view(start, count);
+    }
+
+    void AddBuffer::adopt(AddBuffer&& other) {
+        if (other.blocks.empty()) {
+            return;
+        }
+
+        if (blocks.empty()) {
+            blocks = std::move(other.blocks);
+            used = other.used;
+        } else {
+            // The adopted blocks go before the last one, so appends carry on filling it
+            blocks.insert(blocks.end() - 1, std::make_move_iterator(other.blocks.begin()), std::make_move_iterator(other.blocks.end()));
+        }
+
+        other.blocks.clear();
+        other.used = 0;
+    }
+
+    void AddBuffer::clear() {
+        // The first block is kept, so a buffer that is reused doesn't allocate again
+        if (blocks.size() > 1) {
+            blocks.erase(blocks.begin() + 1, blocks.end());
+        }
+        used = 0;
+    }
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace tree_sitter_format {
+
+// An append-only arena for text that isn't part of a document's original contents (the
+// "add buffer" of a piece table). Appended bytes are copied into blocks that are never
+// resized or moved, so the returned views stay valid until the buffer is cleared or
+// destroyed, even if the buffer itself is moved.
+class AddBuffer {
+private:
+    static constexpr size_t BlockSize = 16 * 1024;
+
+    struct Block {
+        std::unique_ptr<char[]> bytes;
+        size_t capacity;
+    };
+
+    std::vector<Block> blocks;
+
+    // How many bytes of the last block have been used
+    size_t used = 0;
+
+    char* reserve(size_t count);
+
+public:
+    AddBuffer() = default;
+
+    AddBuffer(AddBuffer&&) = default;
+    AddBuffer& operator=(AddBuffer&&) = default;
+
+    std::string_view append(std::string_view bytes);
+    std::string_view appendRepeated(char character, size_t count);
+
+    // Takes over `other`'s blocks without copying them, so the views it returned stay valid
+    // for as long as this buffer's do. `other` is left empty.
+    void adopt(AddBuffer&& other);
+
+    // Calls `visit` with the memory of each block, used or not, to find which buffer a view
+    // was returned by
+    template <typename Visit>
+    void forEachBlock(Visit visit) const {
+        for (const Block& block : blocks) {
+            visit(block.bytes.get(), block.capacity);
+        }
+    }
+
+    // Invalidates every view returned so far. The first block's memory is kept for reuse.
+    void clear();
+};
+
+}
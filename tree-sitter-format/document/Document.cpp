@@ -1,278 +1,1265 @@
 #include <tree-sitter-format/document/Document.h>
 
 #include <tree-sitter-format/Constants.h>
+#include <tree-sitter-format/document/PieceAlgorithms.h>
 
 #include <algorithm>
+#include <cstdlib>
 
 #include <fstream>
-#include <sstream>
+#include <functional>
+#include <iterator>
+#include <unordered_set>
 
 #include <assert.h>
 
 namespace {
     std::string ReadFile(const std::filesystem::path& file) {
-        std::ifstream in(file);
-        std::ostringstream s;
-        s << in.rdbuf();
+        std::ifstream in(file, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    using namespace std::string_view_literals;
+
+    // Every marker comment contains this. It starts with '-', which is rare in code, so
+    // the memchr that looks for its first character doesn't stop very often.
+    constexpr std::string_view FormatMarkerText = "-format o"sv;
+    constexpr uint32_t LongestFormatMarker = uint32_t("// tree-sitter-format off"sv.size());
+    constexpr std::string_view TrailingWhitespace = " \t\r\n"sv;
+
+    TSPoint EndPointOf(TSPoint start, std::string_view bytes) {
+        size_t lastNewLine = bytes.rfind('\n');
+        if (lastNewLine == std::string_view::npos) {
+            return TSPoint {
+                .row = start.row,
+                .column = start.column + uint32_t(bytes.size()),
+            };
+        }
 
-        return s.str();
+        return TSPoint {
+            .row = start.row + uint32_t(std::ranges::count(bytes, '\n')),
+            .column = uint32_t(bytes.size() - lastNewLine - 1),
+        };
     }
 
-    struct FormattableRange {
-        std::vector<tree_sitter_format::Range> ranges;
-        std::optional<TSNode> currentStartNode;
-        const tree_sitter_format::Document& document;
-    };
+    template<typename VISITOR>
+    void VisitNodes(TSNode root, VISITOR&& visit) {
+        TSTreeCursor cursor = ts_tree_cursor_new(root);
+
+        bool done = false;
+        while (!done) {
+            visit(ts_tree_cursor_current_node(&cursor));
+
+            if (ts_tree_cursor_goto_first_child(&cursor)) {
+                continue;
+            }
+
+            while (!ts_tree_cursor_goto_next_sibling(&cursor)) {
+                if (!ts_tree_cursor_goto_parent(&cursor)) {
+                    done = true;
+                    break;
+                }
+            }
+        }
+
+        ts_tree_cursor_delete(&cursor);
+    }
+
+    void CountReusedNodes(const TSTree* oldTree, const TSTree* newTree, tree_sitter_format::ParseStatistics& statistics) {
+        // Subtrees that tree-sitter reuses are shared between the trees rather than copied,
+        // so a node with an id from the old tree is one that didn't have to be reparsed. The
+        // top node of a reused subtree is stored in its new parent, so it isn't counted.
+        std::unordered_set<const void*> oldNodes;
+        VisitNodes(ts_tree_root_node(oldTree), [&](TSNode node) {
+            oldNodes.insert(node.id);
+        });
+
+        VisitNodes(ts_tree_root_node(newTree), [&](TSNode node) {
+            statistics.nodes++;
+            if (oldNodes.contains(node.id)) {
+                statistics.reusedNodes++;
+            }
+        });
 
-    void FindUnformattableRanges(TSTreeCursor* cursor, FormattableRange& r) {
+        statistics.reparses++;
+    }
+
+    // Where each edit ended up in the edited document. The edits are sorted from the end
+    // of the document to the start, the way applyEdits applies them.
+    std::pmr::vector<TSRange> EditedRanges(std::span<const tree_sitter_format::Edit> edits, std::pmr::memory_resource* scratch) {
         using namespace tree_sitter_format;
-        using namespace std::string_view_literals;
 
-        if (ts_tree_cursor_goto_first_child(cursor)) {
-            do {
-                FindUnformattableRanges(cursor, r);
-            } while (ts_tree_cursor_goto_next_sibling(cursor));
-            ts_tree_cursor_goto_parent(cursor);
-        } else {
-            TSNode node = ts_tree_cursor_current_node(cursor);
-            if (ts_node_symbol(node) != COMMENT) {
-                return;
+        std::pmr::vector<TSRange> ranges(scratch);
+        ranges.reserve(edits.size());
+
+        int64_t delta = 0;
+        for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit) {
+            if (const DeleteEdit* d = std::get_if<DeleteEdit>(&*edit)) {
+                uint32_t start = uint32_t(d->range.start.byteOffset + delta);
+                ranges.push_back(TSRange {
+                    .start_byte = start,
+                    .end_byte = start,
+                });
+
+                delta -= d->range.byteCount();
+            } else if (const InsertEdit* i = std::get_if<InsertEdit>(&*edit)) {
+                uint32_t start = uint32_t(i->position.byteOffset + delta);
+                ranges.push_back(TSRange {
+                    .start_byte = start,
+                    .end_byte = start + uint32_t(i->bytes.size()),
+                });
+
+                delta += i->bytes.size();
             }
+        }
 
-            DocumentSlice comment = r.document.slice(Range::Of(node)).trimBack();
+        return ranges;
+    }
 
-            if (r.currentStartNode.has_value()) {
-                if (comment.is("// clang-format on"sv) || comment.is("// tree-sitter-format on"sv)) {
-                    Position start = Position::StartOf(r.currentStartNode.value());
-                    Position end = Position::EndOf(node);
-                    r.ranges.push_back(Range::Between(start, end));
+    // Sorts the ranges and merges any that overlap or touch
+    void Normalize(std::pmr::vector<TSRange>& ranges) {
+        std::ranges::sort(ranges, {}, &TSRange::start_byte);
 
-                    r.currentStartNode = std::nullopt;
-                }
+        size_t merged = 0;
+        for (size_t i = 1; i < ranges.size(); i++) {
+            if (ranges[i].start_byte <= ranges[merged].end_byte) {
+                ranges[merged].end_byte = std::max(ranges[merged].end_byte, ranges[i].end_byte);
             } else {
-                if (comment.is("// clang-format off"sv) || comment.is("// tree-sitter-format off"sv)) {
-                    r.currentStartNode = node;
-                }
+                ranges[++merged] = ranges[i];
             }
         }
+
+        if (!ranges.empty()) {
+            ranges.resize(merged + 1);
+        }
     }
 
-    std::vector<tree_sitter_format::Range> FindUnformattableRanges(const tree_sitter_format::Document& document) {
-        using namespace tree_sitter_format;
+    // Touching counts as intersecting, since an edit right next to a comment can change it
+    bool Intersects(std::span<const TSRange> ranges, uint32_t startByte, uint32_t endByte) {
+        auto range = std::ranges::lower_bound(ranges, startByte, {}, &TSRange::end_byte);
+        return range != ranges.end() && range->start_byte <= endByte;
+    }
 
-        FormattableRange r {
-            .currentStartNode = std::nullopt,
-            .document = document,
-        };
+    // The grammar's extras, other than the escaped new lines that continue a line
+    bool IsWhitespace(char character) {
+        return character == ' ' || character == '\t' || character == '\r' || character == '\n' || character == '\f' || character == '\v';
+    }
 
-        TSTreeCursor cursor = ts_tree_cursor_new(document.root());
-        FindUnformattableRanges(&cursor, r);
-        ts_tree_cursor_delete(&cursor);
+    // The memory of the buffers that applyEdits takes over, to tell which inserted bytes are
+    // already in one of them and don't need copying
+    class OwnedBlocks {
+    private:
+        // [start, end) of each block, by start
+        std::pmr::vector<std::pair<const char*, const char*>> blocks;
+
+        // Inserts are normalized in about the order their bytes were appended, so the block
+        // the last one was found in is checked first
+        size_t last = 0;
+
+    public:
+        OwnedBlocks(std::span<const tree_sitter_format::AddBuffer> buffers, std::pmr::memory_resource* memory) : blocks(memory) {
+            for (const tree_sitter_format::AddBuffer& buffer : buffers) {
+                buffer.forEachBlock([&](const char* bytes, size_t capacity) {
+                    blocks.emplace_back(bytes, bytes + capacity);
+                });
+            }
+
+            std::ranges::sort(blocks, std::less<const char*>(), [](const auto& block) { return block.first; });
+        }
+
+        bool contains(std::string_view bytes) {
+            // std::less orders pointers into different blocks, which < isn't guaranteed to
+            auto within = [&](size_t block) {
+                return std::less_equal<const char*>()(blocks[block].first, bytes.data()) &&
+                    std::less_equal<const char*>()(bytes.data() + bytes.size(), blocks[block].second);
+            };
+
+            if (blocks.empty()) {
+                return false;
+            }
+
+            if (within(last)) {
+                return true;
+            }
+
+            auto after = std::ranges::upper_bound(blocks, bytes.data(), std::less<const char*>(), [](const auto& block) { return block.first; });
+            if (after == blocks.begin()) {
+                return false;
+            }
 
-        if (r.currentStartNode.has_value()) {
-            Position start = Position::StartOf(r.currentStartNode.value());
-            Position end = Position::EndOf(document.root());
-            r.ranges.push_back(Range::Between(start, end));
+            last = size_t(std::prev(after) - blocks.begin());
+            return within(last);
         }
+    };
+
+    // The space between two tokens, or between a token and either end of the document
+    struct Gap {
+        uint32_t startByte;
+        uint32_t endByte;
+    };
 
-        return r.ranges;
+    bool IsLiteral(TSNode node) {
+        TSSymbol symbol = ts_node_symbol(node);
+        return symbol == tree_sitter_format::STRING_LITERAL || symbol == tree_sitter_format::RAW_STRING_LITERAL || symbol == tree_sitter_format::CHAR_LITERAL;
     }
-}
 
-extern "C" {
-const TSLanguage* tree_sitter_cpp(void);
-}
+    bool IsPreprocessorDirective(TSNode node) {
+        return std::string_view(ts_node_type(node)).starts_with("preproc_");
+    }
 
-namespace tree_sitter_format {
+    // Finds the gap that [startByte, endByte) is in, or that an insertion at `startByte` is in
+    // if they are the same. There isn't one if any part of a token would be edited.
+    std::optional<Gap> GapAround(TSNode root, uint32_t startByte, uint32_t endByte, uint32_t length) {
+        Gap gap {
+            .startByte = 0,
+            .endByte = length,
+        };
+
+        std::optional<TSNode> previous;
+        TSNode enclosing = root;
+        bool withinToken = false;
+
+        // Long lists of children are kept in balanced trees of hidden nodes, so jumping to the
+        // child at a byte doesn't have to step over the ones before it.
+        TSTreeCursor cursor = ts_tree_cursor_new(root);
+        while (true) {
+            TSNode parent = ts_tree_cursor_current_node(&cursor);
+            enclosing = parent;
+
+            // The whitespace in a literal is part of it, even where the tree shows the tokens
+            // that start and end it, like a string's quotes, with a gap between them
+            if (IsLiteral(parent)) {
+                withinToken = true;
+                break;
+            }
+
+            if (ts_tree_cursor_goto_first_child_for_byte(&cursor, startByte) < 0) {
+                if (ts_node_child_count(parent) > 0) {
+                    previous = ts_node_child(parent, ts_node_child_count(parent) - 1);
+                }
+                break;
+            }
+
+            TSNode node = ts_tree_cursor_current_node(&cursor);
+            bool hasNext = true;
+            while (hasNext && ts_node_end_byte(node) <= startByte) {
+                previous = node;
+                hasNext = ts_tree_cursor_goto_next_sibling(&cursor);
+                node = ts_tree_cursor_current_node(&cursor);
+            }
+
+            if (!hasNext) {
+                break;
+            }
 
-    size_t Document::splitAtPosition(uint32_t position) {
-        assert(position <= length);
+            if (ts_node_start_byte(node) >= endByte) {
+                gap.endByte = ts_node_start_byte(node);
 
-        if (position == length) {
-            return elements.size();
+                TSNode before = ts_node_prev_sibling(node);
+                if (!ts_node_is_null(before)) {
+                    previous = before;
+                }
+                break;
+            }
+
+            if (ts_node_child_count(node) == 0) {
+                withinToken = true;
+                break;
+            }
         }
 
-        // Find the element with the greatest start point before the split point
-        Location element = findByteLocation(position);
+        ts_tree_cursor_delete(&cursor);
 
-        // If the split is in the middle of this element, split it in two at that point.
-        if (element.offset > 0) {
-            std::string_view remaining = elements[element.index].substr(element.offset);
-            elements.insert(elements.begin() + element.index + 1, remaining);
-            elements[element.index].remove_suffix(remaining.size());
+        if (withinToken) {
+            return std::nullopt;
+        }
 
-            return element.index + 1;
-        } else {
-            return element.index;
+        // A directive's first line ends with a new line token the tree doesn't show, so the
+        // whitespace on that line isn't all between tokens
+        if (previous.has_value() && IsPreprocessorDirective(enclosing) &&
+            ts_node_end_point(previous.value()).row == ts_node_start_point(enclosing).row) {
+            return std::nullopt;
+        }
+
+        if (previous.has_value()) {
+            gap.startByte = ts_node_end_byte(previous.value());
         }
+
+        return gap;
+    }
+
+#ifndef NDEBUG
+    // Whether the trees have the same nodes in the same places
+    bool SameShape(TSNode left, TSNode right) {
+        TSTreeCursor leftCursor = ts_tree_cursor_new(left);
+        TSTreeCursor rightCursor = ts_tree_cursor_new(right);
+
+        // The cursors are moved together, so they only have to be compared after moving down
+        // or across. Moving up can't fail for one and not the other.
+        bool same = true;
+        bool done = false;
+        while (same && !done) {
+            TSNode leftNode = ts_tree_cursor_current_node(&leftCursor);
+            TSNode rightNode = ts_tree_cursor_current_node(&rightCursor);
+            same = ts_node_symbol(leftNode) == ts_node_symbol(rightNode) &&
+                ts_node_start_byte(leftNode) == ts_node_start_byte(rightNode) &&
+                ts_node_end_byte(leftNode) == ts_node_end_byte(rightNode) &&
+                ts_node_start_point(leftNode).row == ts_node_start_point(rightNode).row &&
+                ts_node_start_point(leftNode).column == ts_node_start_point(rightNode).column &&
+                ts_node_end_point(leftNode).row == ts_node_end_point(rightNode).row &&
+                ts_node_end_point(leftNode).column == ts_node_end_point(rightNode).column;
+
+            bool down = ts_tree_cursor_goto_first_child(&leftCursor);
+            if (down != ts_tree_cursor_goto_first_child(&rightCursor)) {
+                same = false;
+            } else if (!down) {
+                while (same) {
+                    bool across = ts_tree_cursor_goto_next_sibling(&leftCursor);
+                    if (across != ts_tree_cursor_goto_next_sibling(&rightCursor)) {
+                        same = false;
+                    } else if (across) {
+                        break;
+                    } else if (!ts_tree_cursor_goto_parent(&leftCursor) || !ts_tree_cursor_goto_parent(&rightCursor)) {
+                        done = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        ts_tree_cursor_delete(&leftCursor);
+        ts_tree_cursor_delete(&rightCursor);
+        return same;
     }
+#endif
+}
+
+extern "C" {
+const TSLanguage* tree_sitter_cpp(void);
+}
+
+namespace tree_sitter_format {
 
     const char* Document::Read(void* payload, uint32_t byte_index, [[maybe_unused]]TSPoint position_unused, uint32_t *bytes_read) {
         Document* document = (Document*)payload;
 
-        if (byte_index >= document->length) {
+        if (byte_index >= document->pieces.length()) {
             *bytes_read = 0;
             return nullptr;
         }
 
-        Location location = document->findByteLocation(byte_index);
-        std::string_view element = document->elements[location.index];
-        element.remove_prefix(location.offset);
+        PieceTree::Location location = document->pieces.find(byte_index);
+        std::string_view element = location.piece->substr(location.offset);
 
         *bytes_read = uint32_t(element.size());
         return element.data();
     }
 
-    Document::Document(const std::filesystem::path& file) : Document(ReadFile(file)) {}
+    Document::Document(const std::filesystem::path& file) {
+        load(file);
+        initialize();
+    }
 
     Document::Document(const std::string& contents) : Document(std::string(contents)) {}
 
-    Document::Document(std::string&& contents) : original(std::move(contents)), parser(ts_parser_new(), ts_parser_delete), tree(nullptr, ts_tree_delete) {
-        elements.emplace_back(original);
-        length = original.size();
+    Document::Document(std::string&& contents) : ownedOriginal(std::move(contents)) {
+        original = ownedOriginal;
+        initialize();
+    }
+
+    Document::Document(Borrowed, std::string_view contents) : original(contents) {
+        initialize();
+    }
+
+    Document Document::FromBorrowedBuffer(std::string_view contents) {
+        return Document(Borrowed(), contents);
+    }
+
+    bool Document::reset(const std::filesystem::path& file) {
+        release();
+        load(file);
+        return initialize();
+    }
+
+    bool Document::reset(std::string&& contents) {
+        release();
+        ownedOriginal = std::move(contents);
+        original = ownedOriginal;
+        return initialize();
+    }
+
+    bool Document::resetToBorrowedBuffer(std::string_view contents) {
+        release();
+        original = contents;
+        return initialize();
+    }
+
+    void Document::load(const std::filesystem::path& file) {
+        std::optional<MappedFile> mapped = MappedFile::Map(file);
+        if (mapped.has_value()) {
+            mappedOriginal = std::move(mapped.value());
+            original = mappedOriginal.contents();
+        } else {
+            ownedOriginal = ReadFile(file);
+            original = ownedOriginal;
+        }
+    }
+
+    void Document::release() {
+        // The containers are cleared rather than replaced, so they keep their capacity for
+        // the next contents.
+        tree.reset();
+        ts_parser_reset(parser.get());
+
+        pieces.clear();
+        added.clear();
+        formatMarkers.clear();
+        unformattableRanges.clear();
+
+        ownedOriginal.clear();
+        mappedOriginal = MappedFile();
+        original = std::string_view();
+
+        documentRange = Range();
+        encoding = Utf8Validation();
+        scratch.release();
+        if (statistics.has_value()) {
+            statistics = ParseStatistics();
+        }
+    }
+
+    bool Document::initialize() {
+        pieces.assign(original);
+        lines.assign(original);
+
+        encoding = ValidateUtf8(original);
+        if (!isValidUtf8()) {
+            documentRange.end = positionAt(pieces.length());
+            return false;
+        }
+
+        if (ts_parser_language(parser.get()) == nullptr) {
+            ts_parser_set_language(parser.get(), tree_sitter_cpp());
+        }
 
-        ts_parser_set_language(parser.get(), tree_sitter_cpp());
         tree.reset(ts_parser_parse(parser.get(), nullptr, inputReader()));
+        if (tree == nullptr) {
+            ts_parser_reset(parser.get());
+            documentRange.end = positionAt(pieces.length());
+            return false;
+        }
+
+        documentRange.end = Position::EndOf(root());
 
-        elementRange.end = Position::EndOf(root());
+        rescanFormatMarkers(std::pmr::vector<TSRange>({TSRange {
+            .start_byte = 0,
+            .end_byte = pieces.length(),
+        }}, &scratch));
+        buildUnformattableRanges();
 
-        unformattableRanges = FindUnformattableRanges(*this);
+        return true;
     }
 
     void Document::insertBytes(const Position& position, std::string_view bytes) {
-        size_t insertPosition = splitAtPosition(position.byteOffset);
-        elements.insert(elements.begin() + insertPosition, bytes);
-
-        length += bytes.size();
-
-        TSInputEdit edit {
-            .start_byte = position.byteOffset,
-            .old_end_byte = position.byteOffset,
-            .new_end_byte = position.byteOffset + uint32_t(bytes.size()),
-            .start_point = position.location,
-            .old_end_point = position.location,
-            .new_end_point = TSPoint{
-                .row = position.location.row,
-                .column = position.location.column + uint32_t(bytes.size()),
-            },
+        pieces.insert(position.byteOffset, bytes);
+    }
+
+    void Document::deleteBytes(const Range& range) {
+        // If we were asked to delete past the end of the contents, just ignore that part
+        uint32_t start = std::min(range.start.byteOffset, pieces.length());
+        uint32_t count = std::min(range.byteCount(), pieces.length() - start);
+        pieces.erase(start, count);
+    }
+
+    std::pmr::vector<Edit> Document::normalizeEdits(const std::vector<Edit>& edits, std::span<const AddBuffer> texts) {
+        std::pmr::vector<Edit> normalized(&scratch);
+        normalized.reserve(edits.size());
+
+        std::pmr::string previous(&scratch);
+        uint32_t length = pieces.length();
+        OwnedBlocks owned(texts, &scratch);
+
+        // Replaces [start, end) with `bytes`, leaving out the bytes at either end that
+        // wouldn't change. Edits are added in document order, and reversed at the end.
+        auto replace = [&](uint32_t start, uint32_t end, std::string_view bytes, bool ownsBytes) {
+            previous.clear();
+            if (end > start) {
+                PieceTree::Location location = pieces.find(start);
+                VisitPieces(location.piece, location.offset, end - start, [&](std::string_view element) {
+                    previous.append(element);
+                });
+            }
+
+            std::string_view old = previous;
+            while (!old.empty() && !bytes.empty() && old.front() == bytes.front()) {
+                old.remove_prefix(1);
+                bytes.remove_prefix(1);
+                start++;
+            }
+            while (!old.empty() && !bytes.empty() && old.back() == bytes.back()) {
+                old.remove_suffix(1);
+                bytes.remove_suffix(1);
+            }
+
+            Position position = positionAt(start);
+            if (!bytes.empty()) {
+                normalized.push_back(InsertEdit {
+                    .position = position,
+                    .bytes = !ownsBytes && owned.contains(bytes) ? bytes : added.append(bytes),
+                });
+            }
+
+            if (!old.empty()) {
+                normalized.push_back(DeleteEdit {
+                    .range = Range::Between(position, positionAt(start + uint32_t(old.size()))),
+                });
+            }
         };
 
-        ts_tree_edit(tree.get(), &edit);
+        // Edits that overlap or touch are gathered into a single replacement. Their inserted
+        // bytes only need joining when there is more than one insert, which is rare. Joined
+        // bytes are kept in a scratch string, so they are always copied into the document.
+        std::optional<uint32_t> groupStart;
+        uint32_t groupEnd = 0;
+        std::string_view groupBytes;
+        std::pmr::string groupText(&scratch);
+        bool groupJoined = false;
+
+        for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit) {
+            uint32_t start = 0;
+            uint32_t end = 0;
+            std::string_view bytes;
+            if (const DeleteEdit* d = std::get_if<DeleteEdit>(&*edit)) {
+                start = std::min(d->range.start.byteOffset, length);
+                end = std::min(d->range.end.byteOffset, length);
+            } else if (const InsertEdit* i = std::get_if<InsertEdit>(&*edit)) {
+                start = end = i->position.byteOffset;
+                bytes = i->bytes;
+            }
+
+            if (!groupStart.has_value() || start > groupEnd) {
+                if (groupStart.has_value()) {
+                    replace(groupStart.value(), groupEnd, groupJoined ? groupText : groupBytes, groupJoined);
+                }
+
+                groupStart = start;
+                groupEnd = end;
+                groupBytes = bytes;
+                groupJoined = false;
+                continue;
+            }
+
+            groupEnd = std::max(groupEnd, end);
+            if (!bytes.empty()) {
+                if (!groupJoined && !groupBytes.empty()) {
+                    groupText.assign(groupBytes);
+                    groupJoined = true;
+                }
+
+                if (groupJoined) {
+                    groupText.append(bytes);
+                } else {
+                    groupBytes = bytes;
+                }
+            }
+        }
+
+        if (groupStart.has_value()) {
+            replace(groupStart.value(), groupEnd, groupJoined ? groupText : groupBytes, groupJoined);
+        }
+
+        std::ranges::reverse(normalized);
+        return normalized;
     }
 
-    void Document::deleteBytes(const Range& range) {
-        size_t deletePosition = splitAtPosition(range.start.byteOffset);
+    void Document::rebuildPieces(std::span<const Edit> edits) {
+        std::pmr::vector<std::string_view> rebuilt(&scratch);
+        rebuilt.reserve(pieces.size() + 2 * edits.size());
+
+        // Pieces that are next to each other in memory, like the two halves of a piece
+        // split by an empty edit, are joined back together.
+        auto push = [&](std::string_view piece) {
+            if (!rebuilt.empty() && rebuilt.back().data() + rebuilt.back().size() == piece.data()) {
+                rebuilt.back() = std::string_view(rebuilt.back().data(), rebuilt.back().size() + piece.size());
+            } else if (!piece.empty()) {
+                rebuilt.push_back(piece);
+            }
+        };
+
+        PieceTree::const_iterator piece = pieces.begin();
+        std::string_view current = piece == pieces.end() ? std::string_view() : *piece;
+        uint32_t consumed = 0;
+
+        // Moves through the old pieces up to `byteOffset`, keeping what it passes if `keep` is set
+        auto consumeUpTo = [&](uint32_t byteOffset, bool keep) {
+            while (consumed < byteOffset && piece != pieces.end()) {
+                uint32_t count = std::min(uint32_t(current.size()), byteOffset - consumed);
+                if (keep) {
+                    push(current.substr(0, count));
+                }
+
+                current.remove_prefix(count);
+                consumed += count;
 
-        // Start deleting
-        size_t bytesRemaining = range.byteCount();
-        while(bytesRemaining > 0) {
-            // If we were asked to delete past the end of the contents, just ignore it
-            if (deletePosition >= elements.size()) {
-                return;
+                if (current.empty() && ++piece != pieces.end()) {
+                    current = *piece;
+                }
             }
+        };
 
-            std::string_view& element = elements[deletePosition];
+        for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit) {
+            if (const DeleteEdit* d = std::get_if<DeleteEdit>(&*edit)) {
+                consumeUpTo(d->range.start.byteOffset, true);
+                consumeUpTo(d->range.end.byteOffset, false);
+            } else if (const InsertEdit* i = std::get_if<InsertEdit>(&*edit)) {
+                consumeUpTo(i->position.byteOffset, true);
+                push(i->bytes);
+            }
+        }
 
-            size_t bytesToDelete = std::min(bytesRemaining, element.size());
-            bytesRemaining -= bytesToDelete;
-            length -= bytesToDelete;
+        consumeUpTo(UINT32_MAX, true);
+        pieces.assign(rebuilt.begin(), rebuilt.end());
+    }
 
-            element.remove_prefix(bytesToDelete);
-            if (element.empty()) {
-                elements.erase(elements.begin() + deletePosition);
+    void Document::editTree(std::span<const Edit> edits) {
+        // Edits that touch, like a delete and the insert that replaces what it deleted, are
+        // reported to tree-sitter as a single edit. Each ts_tree_edit walks the tree, so this
+        // roughly halves the work for the replacements most traversers make.
+        std::pmr::vector<TSInputEdit> treeEdits(&scratch);
+        treeEdits.reserve(edits.size());
+
+        for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit) {
+            Range replaced;
+            std::string_view bytes;
+            if (const DeleteEdit* d = std::get_if<DeleteEdit>(&*edit)) {
+                replaced = d->range;
+            } else if (const InsertEdit* i = std::get_if<InsertEdit>(&*edit)) {
+                replaced = Range {.start = i->position, .end = i->position};
+                bytes = i->bytes;
+            }
+
+            if (!treeEdits.empty() && treeEdits.back().old_end_byte == replaced.start.byteOffset) {
+                TSInputEdit& previous = treeEdits.back();
+                previous.old_end_byte = replaced.end.byteOffset;
+                previous.old_end_point = replaced.end.location;
+                previous.new_end_byte += uint32_t(bytes.size());
+                previous.new_end_point = EndPointOf(previous.new_end_point, bytes);
+            } else {
+                treeEdits.push_back(TSInputEdit {
+                    .start_byte = replaced.start.byteOffset,
+                    .old_end_byte = replaced.end.byteOffset,
+                    .new_end_byte = replaced.start.byteOffset + uint32_t(bytes.size()),
+                    .start_point = replaced.start.location,
+                    .old_end_point = replaced.end.location,
+                    .new_end_point = EndPointOf(replaced.start.location, bytes),
+                });
             }
         }
 
-        TSInputEdit edit {
-            .start_byte = range.start.byteOffset,
-            .old_end_byte = range.end.byteOffset,
-            .new_end_byte = range.start.byteOffset,
-            .start_point = range.start.location,
-            .old_end_point = range.end.location,
-            .new_end_point = range.start.location,
+        // Like the pieces, the tree is edited from the end of the document to the start so
+        // that every edit's original coordinates are still correct when it is applied.
+        for (auto edit = treeEdits.rbegin(); edit != treeEdits.rend(); ++edit) {
+            ts_tree_edit(tree.get(), &*edit);
+        }
+    }
+
+    std::optional<std::pmr::vector<TSInputEdit>> Document::whitespaceTreeEdits(std::span<const Edit> edits) {
+        if (tree == nullptr || ts_node_has_error(root())) {
+            return std::nullopt;
+        }
+
+        std::pmr::vector<TSInputEdit> treeEdits(&scratch);
+        treeEdits.reserve(edits.size());
+
+        // Every edit in a gap has to be seen before it is known whether the gap was emptied,
+        // or lost or gained its only new lines
+        std::optional<Gap> gap;
+        std::pmr::string gapText(&scratch);
+        int64_t gapBytes = 0;
+        int64_t gapNewLines = 0;
+
+        auto keepsGap = [&]() {
+            if (!gap.has_value()) {
+                return true;
+            }
+
+            int64_t oldNewLines = std::ranges::count(gapText, '\n');
+            return (gapBytes > 0) == !gapText.empty() && (gapNewLines > 0) == (oldNewLines > 0);
         };
 
-        ts_tree_edit(tree.get(), &edit);
+        // Normalized edits are sorted from the end of the document, and a delete and an
+        // insert at the same position make up one replacement
+        for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit) {
+            Position start;
+            uint32_t endByte = 0;
+            std::string_view bytes;
+            if (const DeleteEdit* d = std::get_if<DeleteEdit>(&*edit)) {
+                start = d->range.start;
+                endByte = d->range.end.byteOffset;
+            } else if (const InsertEdit* i = std::get_if<InsertEdit>(&*edit)) {
+                start = i->position;
+                endByte = start.byteOffset;
+                bytes = i->bytes;
+            }
+
+            auto next = std::next(edit);
+            if (next != edits.rend()) {
+                const InsertEdit* i = std::get_if<InsertEdit>(&*next);
+                const DeleteEdit* d = std::get_if<DeleteEdit>(&*next);
+                if (i != nullptr && i->position.byteOffset == start.byteOffset) {
+                    bytes = i->bytes;
+                    ++edit;
+                } else if (d != nullptr && d->range.start.byteOffset == start.byteOffset) {
+                    endByte = d->range.end.byteOffset;
+                    ++edit;
+                }
+            }
+
+            if (!std::ranges::all_of(bytes, IsWhitespace)) {
+                return std::nullopt;
+            }
+
+            std::optional<Gap> around = GapAround(root(), start.byteOffset, endByte, pieces.length());
+            if (!around.has_value()) {
+                return std::nullopt;
+            }
+
+            if (!gap.has_value() || gap->startByte != around->startByte) {
+                if (!keepsGap()) {
+                    return std::nullopt;
+                }
+
+                gap = around;
+                gapText.clear();
+                if (gap->endByte > gap->startByte) {
+                    PieceTree::Location location = pieces.find(gap->startByte);
+                    VisitPieces(location.piece, location.offset, gap->endByte - gap->startByte, [&](std::string_view element) {
+                        gapText.append(element);
+                    });
+                }
+
+                // Tokens the tree doesn't show, and escaped new lines, aren't whitespace
+                if (!std::ranges::all_of(gapText, IsWhitespace)) {
+                    return std::nullopt;
+                }
+
+                gapBytes = int64_t(gapText.size());
+                gapNewLines = std::ranges::count(gapText, '\n');
+            }
+
+            // tree-sitter adds bytes inserted right at the end of a token to the token, and the
+            // lexer would add spaces after a line comment to the comment, so only what's deleted
+            // can start at the token before the gap. The start of the document isn't a token.
+            if (start.byteOffset == gap->startByte && gap->startByte > 0 && !bytes.empty()) {
+                return std::nullopt;
+            }
+
+            std::string_view deleted = std::string_view(gapText).substr(start.byteOffset - gap->startByte, endByte - start.byteOffset);
+            gapBytes += int64_t(bytes.size()) - int64_t(deleted.size());
+            gapNewLines += std::ranges::count(bytes, '\n') - std::ranges::count(deleted, '\n');
+
+            treeEdits.push_back(TSInputEdit {
+                .start_byte = start.byteOffset,
+                .old_end_byte = endByte,
+                .new_end_byte = start.byteOffset + uint32_t(bytes.size()),
+                .start_point = start.location,
+                .old_end_point = positionAt(endByte).location,
+                .new_end_point = EndPointOf(start.location, bytes),
+            });
+        }
+
+        if (!keepsGap()) {
+            return std::nullopt;
+        }
+
+        return treeEdits;
     }
 
-    void Document::applyEdits(std::vector<Edit> edits) {
-        std::ranges::sort(edits);
+    void Document::applyToPieces(std::span<const Edit> edits) {
+        // Each edit made in place costs a split and a merge of the piece tree, so once there
+        // are enough of them it is cheaper to build the new piece list in one pass.
+        if (edits.size() < pieces.size() / 32) {
+            for (const Edit& edit : edits) {
+                if (const DeleteEdit* d = std::get_if<DeleteEdit>(&edit)) {
+                    deleteBytes(d->range);
+                } else if (const InsertEdit* i = std::get_if<InsertEdit>(&edit)) {
+                    insertBytes(i->position, i->bytes);
+                }
+            }
+        } else {
+            rebuildPieces(edits);
+        }
+    }
+
+#ifndef NDEBUG
+    bool Document::matchesReparse() {
+        std::unique_ptr<TSTree, TSTreeDeleter> reparsed {ts_parser_parse(parser.get(), nullptr, inputReader()), ts_tree_delete};
+        if (reparsed == nullptr) {
+            // Stopped by the timeout or the cancellation flag, so there's nothing to compare with
+            ts_parser_reset(parser.get());
+            return true;
+        }
+
+        return SameShape(root(), ts_tree_root_node(reparsed.get()));
+    }
+#endif
+
+    bool Document::applyEdits(std::vector<Edit> edits) {
+        return applyEdits(std::move(edits), {});
+    }
+
+    bool Document::applyEdits(std::vector<Edit> edits, std::vector<AddBuffer> texts) {
+        // A stable sort keeps inserts at the same position in a consistent order. They end
+        // up in the document in the reverse of the order they were added.
+        std::ranges::stable_sort(edits);
+
+        // Traversers replace text whether or not it changes, like reindenting a line that
+        // is already indented correctly. If nothing is really changing, there's no need to
+        // reparse.
+        std::pmr::vector<Edit> normalized = normalizeEdits(edits, texts);
+        if (normalized.empty()) {
+            return true;
+        }
+
+        for (AddBuffer& text : texts) {
+            added.adopt(std::move(text));
+        }
+
+        // Most traversers only change the whitespace between tokens. That can't change the
+        // tree, only where its nodes are, so the tree is moved instead of reparsed.
+        std::optional<std::pmr::vector<TSInputEdit>> shifts = whitespaceTreeEdits(normalized);
+        std::unique_ptr<TSTree, TSTreeDeleter> oldTree {nullptr, ts_tree_delete};
+
+        if (shifts.has_value()) {
+            applyToPieces(normalized);
+
+            // Like the pieces, the tree is edited from the end of the document to the start
+            for (auto edit = shifts->rbegin(); edit != shifts->rend(); ++edit) {
+                ts_tree_edit(tree.get(), &*edit);
+            }
+
+            assert(matchesReparse());
+        } else {
+            // If the parse might be stopped, keep what is needed to undo the edits. Copying
+            // the tree is cheap, the copies share their nodes until one of them is edited.
+            std::optional<PieceTree> previousPieces;
+            std::unique_ptr<TSTree, TSTreeDeleter> previousTree {nullptr, ts_tree_delete};
+            if (parseCanStop()) {
+                previousPieces = pieces;
+                previousTree.reset(ts_tree_copy(tree.get()));
+            }
+
+            applyToPieces(normalized);
+            editTree(normalized);
+
+            oldTree = std::move(tree);
+            tree.reset(ts_parser_parse(parser.get(), oldTree.get(), inputReader()));
+            if (tree == nullptr) {
+                ts_parser_reset(parser.get());
+
+                // Without a timeout or a cancellation flag the parse only fails if the parser
+                // can't parse at all, and nothing was kept to undo the edits with. Like a
+                // failed load, the document keeps its contents but has no tree.
+                if (!previousPieces.has_value()) {
+                    lines.update(normalized, &scratch);
+                    documentRange.end = positionAt(pieces.length());
+                    return false;
+                }
+
+                pieces = std::move(previousPieces.value());
+                tree = std::move(previousTree);
+                return false;
+            }
+        }
+
+        lines.update(normalized, &scratch);
+        shiftFormatMarkers(normalized);
 
-        for(const Edit& edit : edits) {
-            if (std::holds_alternative<DeleteEdit>(edit)) {
-                const DeleteEdit& d = std::get<DeleteEdit>(edit);
-                deleteBytes(d.range);
-            } else if (std::holds_alternative<InsertEdit>(edit)) {
-                const InsertEdit& i = std::get<InsertEdit>(edit);
-                insertBytes(i.position, i.bytes);
+        // Deleting can't add anything that isn't ASCII, so only inserts need checking
+        for (const Edit& edit : normalized) {
+            const InsertEdit* i = std::get_if<InsertEdit>(&edit);
+            if (encoding.isAscii && i != nullptr) {
+                encoding.isAscii = ValidateUtf8(i->bytes).isAscii;
             }
         }
 
-        tree.reset(ts_parser_parse(parser.get(), tree.release(), inputReader()));
-        elementRange.end = Position::EndOf(root());
-        // TODO delete old tree or no?
+        documentRange.end = Position::EndOf(root());
+
+        if (statistics.has_value()) {
+            if (oldTree != nullptr) {
+                CountReusedNodes(oldTree.get(), tree.get(), statistics.value());
+            } else {
+                statistics->shifts++;
+            }
+        }
+
+        // Comments can only have changed where the text was edited, or where tree-sitter
+        // says the structure of the tree changed.
+        std::pmr::vector<TSRange> changedRanges = EditedRanges(normalized, &scratch);
+
+        if (oldTree != nullptr) {
+            uint32_t changedRangeCount = 0;
+            TSRange* treeChanges = ts_tree_get_changed_ranges(oldTree.get(), tree.get(), &changedRangeCount);
+            changedRanges.insert(changedRanges.end(), treeChanges, treeChanges + changedRangeCount);
+            free(treeChanges);
+        }
+
+        rescanFormatMarkers(std::move(changedRanges));
+        buildUnformattableRanges();
 
-        unformattableRanges = FindUnformattableRanges(*this);
+        return true;
     }
 
-    const std::string& Document::originalContents() const {
-        return original;
+    bool Document::parseCanStop() const {
+        return ts_parser_timeout_micros(parser.get()) > 0 || ts_parser_cancellation_flag(parser.get()) != nullptr;
     }
 
-    const std::string_view Document::originalContentsAt(const Range& range) const {
-        return std::string_view(original).substr(range.start.byteOffset, range.byteCount());
+    void Document::setParseTimeout(std::chrono::microseconds timeout) {
+        ts_parser_set_timeout_micros(parser.get(), uint64_t(std::max(timeout.count(), std::chrono::microseconds::rep(0))));
     }
 
-    bool Document::overlapsUnformattableRange(const Range& range) const {
-        for(const Range& unformattableRange : unformattableRanges) {
-            if (unformattableRange.start >= range.end) {
-                break;
+    void Document::setCancellationFlag(const std::atomic_size_t* flag) {
+        // tree-sitter reads the flag with an atomic load, it just takes it as a plain size_t
+        static_assert(sizeof(std::atomic_size_t) == sizeof(size_t) && std::atomic_size_t::is_always_lock_free);
+        ts_parser_set_cancellation_flag(parser.get(), reinterpret_cast<const size_t*>(flag));
+    }
+
+    void Document::shiftFormatMarkers(std::span<const Edit> edits) {
+        std::pmr::vector<FormatMarker> shifted(&scratch);
+        shifted.reserve(formatMarkers.size());
+
+        size_t next = 0;
+        int64_t delta = 0;
+
+        auto keepUpTo = [&](uint32_t byteOffset) {
+            while (next < formatMarkers.size() && formatMarkers[next].endByte <= byteOffset) {
+                FormatMarker marker = formatMarkers[next++];
+                marker.startByte = uint32_t(marker.startByte + delta);
+                marker.endByte = uint32_t(marker.endByte + delta);
+                shifted.push_back(marker);
             }
+        };
 
-            if (unformattableRange.end > range.start) {
-                return true;
+        for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit) {
+            uint32_t start = 0;
+            uint32_t end = 0;
+            int64_t change = 0;
+
+            if (const DeleteEdit* d = std::get_if<DeleteEdit>(&*edit)) {
+                start = d->range.start.byteOffset;
+                end = d->range.end.byteOffset;
+                change = -int64_t(d->range.byteCount());
+            } else if (const InsertEdit* i = std::get_if<InsertEdit>(&*edit)) {
+                start = i->position.byteOffset;
+                end = start;
+                change = i->bytes.size();
             }
+
+            keepUpTo(start);
+
+            // Markers the edit changed are dropped. The edited range is rescanned, so they
+            // are found again if they are still markers.
+            while (next < formatMarkers.size() && formatMarkers[next].startByte < end) {
+                next++;
+            }
+
+            delta += change;
         }
 
-        return false;
+        keepUpTo(UINT32_MAX);
+        formatMarkers.assign(shifted.begin(), shifted.end());
     }
 
-    bool Document::isWithinAnUnformattableRange(const Range& range) const {
-        for(const Range& unformattableRange : unformattableRanges) {
-            if (unformattableRange.start >= range.end) {
-                break;
+    std::optional<Document::FormatMarker> Document::formatMarkerAt(uint32_t byteOffset) const {
+        using namespace std::string_view_literals;
+
+        TSNode node = ts_node_descendant_for_byte_range(root(), byteOffset, byteOffset + 1);
+        if (ts_node_symbol(node) != COMMENT) {
+            return std::nullopt;
+        }
+
+        // Markers can only be followed by whitespace, so longer comments can be ruled
+        // out without copying them out of the pieces.
+        uint32_t start = ts_node_start_byte(node);
+        uint32_t length = ts_node_end_byte(node) - start;
+        if (length > LongestFormatMarker && TrailingWhitespace.find(characterAt(start + LongestFormatMarker)) == std::string_view::npos) {
+            return std::nullopt;
+        }
+
+        std::string text = contentsAtAsString(Range::Of(node));
+        std::string_view comment = std::string_view(text).substr(0, text.find_last_not_of(TrailingWhitespace) + 1);
+
+        bool formatOff = comment == "// clang-format off"sv || comment == "// tree-sitter-format off"sv;
+        bool formatOn = comment == "// clang-format on"sv || comment == "// tree-sitter-format on"sv;
+        if (!formatOff && !formatOn) {
+            return std::nullopt;
+        }
+
+        return FormatMarker {
+            .startByte = start,
+            .endByte = ts_node_end_byte(node),
+            .formatOff = formatOff,
+        };
+    }
+
+    void Document::rescanFormatMarkers(std::pmr::vector<TSRange> ranges) {
+        Normalize(ranges);
+        if (ranges.empty()) {
+            return;
+        }
+
+        std::erase_if(formatMarkers, [&](const FormatMarker& marker) {
+            return Intersects(ranges, marker.startByte, marker.endByte);
+        });
+
+        // Rather than look at every comment in the ranges, search the text for the part all of
+        // the markers share, and only look at comments where it is found. Most files don't
+        // have any markers, so usually no comments are looked at.
+        std::pmr::vector<uint32_t> candidates(&scratch);
+        for (const TSRange& range : ranges) {
+            // A marker that touches the range can start before it. Its text is within this
+            // window unless the comment has a lot of trailing whitespace, in which case the
+            // comment covers the start of the range.
+            uint32_t start = range.start_byte - std::min(range.start_byte, LongestFormatMarker);
+            uint32_t end = std::min(range.end_byte + LongestFormatMarker, pieces.length());
+
+            if (range.start_byte > 0) {
+                candidates.push_back(range.start_byte - 1);
             }
+            candidates.push_back(range.start_byte);
 
-            if (unformattableRange.start <= range.start && unformattableRange.end > range.start) {
-                return true;
+            if (start < end) {
+                PieceTree::Location location = pieces.find(start);
+                FindAll(location.piece, location.offset, end - start, FormatMarkerText, [&](uint32_t offset) {
+                    candidates.push_back(start + offset);
+                });
             }
+        }
 
-            if (unformattableRange.start < range.end && unformattableRange.end >= range.end) {
-                return true;
+        for (uint32_t candidate : candidates) {
+            if (candidate >= pieces.length()) {
+                continue;
+            }
+
+            std::optional<FormatMarker> marker = formatMarkerAt(candidate);
+            if (marker.has_value() && Intersects(ranges, marker->startByte, marker->endByte)) {
+                formatMarkers.push_back(marker.value());
             }
         }
 
-        return false;
+        // Overlapping windows can find the same marker more than once
+        std::ranges::sort(formatMarkers, {}, &FormatMarker::startByte);
+        auto duplicates = std::ranges::unique(formatMarkers, {}, &FormatMarker::startByte);
+        formatMarkers.erase(duplicates.begin(), duplicates.end());
     }
 
-    bool Document::isWithinAnUnformattableRange(const Position& position) const {
-        for(const Range& unformattableRange : unformattableRanges) {
-            if (unformattableRange.start > position) {
-                break;
+    void Document::buildUnformattableRanges() {
+        unformattableRanges.clear();
+
+        // An "on" marker without an "off" before it, or an "off" marker when formatting is
+        // already off, is ignored.
+        std::optional<uint32_t> formatOffStart;
+        for (const FormatMarker& marker : formatMarkers) {
+            if (formatOffStart.has_value() && !marker.formatOff) {
+                unformattableRanges.push_back(Range::Between(positionAt(formatOffStart.value()), positionAt(marker.endByte)));
+                formatOffStart = std::nullopt;
+            } else if (!formatOffStart.has_value() && marker.formatOff) {
+                formatOffStart = marker.startByte;
             }
+        }
 
-            if (unformattableRange.start <= position && unformattableRange.end > position) {
-                return true;
+        if (formatOffStart.has_value()) {
+            unformattableRanges.push_back(Range::Between(positionAt(formatOffStart.value()), documentRange.end));
+        }
+    }
+
+    void Document::collectParseStatistics() {
+        statistics = ParseStatistics();
+    }
+
+    DocumentSlice Document::slice(const Range& subRange) const {
+        return DocumentSlice(pieces, subRange);
+    }
+
+    std::vector<std::string_view> Document::contentsAt(Range subRange) const {
+        std::vector<std::string_view> contents;
+
+        // If the subrange is empty, just return an empty contents.
+        if (subRange.start == subRange.end) {
+            contents.push_back(std::string_view());
+            return contents;
+        }
+
+        PieceTree::Location location = pieces.find(subRange.start.byteOffset);
+        VisitPieces(location.piece, location.offset, subRange.byteCount(), [&](std::string_view element) {
+            contents.push_back(element);
+        });
+
+        return contents;
+    }
+
+    std::string Document::contentsAtAsString(Range subRange) const {
+        std::string s;
+        s.reserve(subRange.byteCount());
+
+        if (subRange.byteCount() == 0) {
+            return s;
+        }
+
+        PieceTree::Location location = pieces.find(subRange.start.byteOffset);
+        VisitPieces(location.piece, location.offset, subRange.byteCount(), [&](std::string_view element) {
+            s.append(element);
+        });
+
+        return s;
+    }
+
+    char Document::characterAt(uint32_t bytePosition) const {
+        PieceTree::Location location = pieces.find(bytePosition);
+        return (*location.piece)[location.offset];
+    }
+
+    Range Document::lineRange(uint32_t row) const {
+        assert(row < lines.lineCount());
+
+        uint32_t start = lines.lineStart(row);
+        uint32_t end = pieces.length();
+        if (row + 1 < lines.lineCount()) {
+            end = lines.lineStart(row + 1) - 1;
+            if (end > start && characterAt(end - 1) == '\r') {
+                end--;
+            }
+        }
+
+        return Range::Between(positionAt(start), Position {
+            .location = TSPoint {
+                .row = row,
+                .column = end - start,
+            },
+            .byteOffset = end,
+        });
+    }
+
+    Position Document::positionAt(uint32_t byteOffset) const {
+        uint32_t row = lines.rowAt(byteOffset);
+
+        return Position {
+            .location = TSPoint {
+                .row = row,
+                .column = byteOffset - lines.lineStart(row),
+            },
+            .byteOffset = byteOffset,
+        };
+    }
+
+    Range Document::nextNewLine(Position start) const {
+        assert(lines.rowAt(start.byteOffset) == start.location.row);
+
+        uint32_t row = start.location.row;
+        uint32_t lineStart = start.byteOffset;
+
+        for (; row + 1 < lines.lineCount(); row++, lineStart = lines.lineStart(row)) {
+            uint32_t lineFeed = lines.lineStart(row + 1) - 1;
+
+            uint32_t newLineStart = lineFeed;
+            if (newLineStart > lineStart && characterAt(newLineStart - 1) == '\r') {
+                newLineStart--;
+            }
+
+            // A new line after an odd number of backslashes is escaped, and continues the line
+            uint32_t backslashes = 0;
+            while (newLineStart - backslashes > lineStart && characterAt(newLineStart - backslashes - 1) == '\\') {
+                backslashes++;
             }
+
+            if (backslashes % 2 == 0) {
+                return Range::Between(positionAt(newLineStart), Position {
+                    .location = TSPoint {
+                        .row = row + 1,
+                        .column = 0,
+                    },
+                    .byteOffset = lineFeed + 1,
+                });
+            }
+        }
+
+        Position endOfFile = positionAt(pieces.length());
+        return Range::Between(endOfFile, endOfFile);
+    }
+
+    Range Document::toNextNewLine(Position start) const {
+        Range newLine = nextNewLine(start);
+
+        return Range {
+            .start = start,
+            .end = newLine.start,
+        };
+    }
+
+    Range Document::toPreviousNewLine(Position end) const {
+        Position start {
+            .location = TSPoint {
+                .row = end.location.row,
+                .column = 0,
+            },
+            .byteOffset = lines.lineStart(end.location.row),
+        };
+
+        return Range::Between(start, end);
+    }
+
+    uint32_t Document::displayColumn(const Position& position) const {
+        if (encoding.isAscii) {
+            return position.location.column;
+        }
+
+        Range line = toPreviousNewLine(position);
+        uint32_t column = 0;
+        if (line.byteCount() > 0) {
+            PieceTree::Location location = pieces.find(line.start.byteOffset);
+            VisitPieces(location.piece, location.offset, line.byteCount(), [&](std::string_view element) {
+                column += CountLeadBytes(element);
+            });
         }
 
-        return false;
+        return column;
+    }
+
+    std::string Document::toString() const {
+        std::string s;
+        s.reserve(pieces.length());
+
+        for (std::string_view piece : pieces) {
+            s.append(piece);
+        }
+
+        return s;
+    }
+
+    const std::string_view Document::originalContentsAt(const Range& range) const {
+        return original.substr(range.start.byteOffset, range.byteCount());
+    }
+
+    bool Document::overlapsUnformattableRange(const Range& range) const {
+        return unformattableRanges.overlaps(range);
+    }
+
+    bool Document::isWithinAnUnformattableRange(const Range& range) const {
+        return unformattableRanges.containsEndPointOf(range);
+    }
+
+    bool Document::isWithinAnUnformattableRange(const Position& position) const {
+        return unformattableRanges.contains(position);
     }
 
     TSNode Document::root() const {
         return ts_tree_root_node(tree.get());
     }
 
+    std::unique_ptr<TSTree, TSTreeDeleter> Document::copyTree() const {
+        return std::unique_ptr<TSTree, TSTreeDeleter>(ts_tree_copy(tree.get()), ts_tree_delete);
+    }
+
     TSInput Document::inputReader() {
         return TSInput {
             .payload = this,
@@ -281,4 +1268,12 @@ namespace tree_sitter_format {
         };
     }
 
+    std::ostream& operator<<(std::ostream& out, const Document& document) {
+        for(const std::string_view& e : document.contents()) {
+            out << e;
+        }
+
+        return out;
+    }
+
 }
@@ -1,15 +1,28 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <filesystem>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <ostream>
 #include <string>
 #include <vector>
 
 #include <tree_sitter/api.h>
 
+#include <tree-sitter-format/document/AddBuffer.h>
 #include <tree-sitter-format/document/Edits.h>
+#include <tree-sitter-format/document/LineIndex.h>
+#include <tree-sitter-format/document/MappedFile.h>
 #include <tree-sitter-format/document/Position.h>
 #include <tree-sitter-format/document/Range.h>
+#include <tree-sitter-format/document/RangeIndex.h>
 #include <tree-sitter-format/document/DocumentSlice.h>
+#include <tree-sitter-format/document/PieceTree.h>
+#include <tree-sitter-format/document/ScanKernels.h>
 
 // https://en.wikipedia.org/wiki/Piece_table
 
@@ -18,30 +31,187 @@ namespace tree_sitter_format {
 using TSParserDeleter = decltype(&ts_parser_delete);
 using TSTreeDeleter = decltype(&ts_tree_delete);
 
-class Document : public DocumentSlice {
-private:
-    std::string original;
+// How much of the previous tree tree-sitter was able to reuse when reparsing after edits
+struct ParseStatistics {
+    uint32_t reparses = 0;
+    uint32_t nodes = 0;
+    uint32_t reusedNodes = 0;
 
-    std::unique_ptr<TSParser, TSParserDeleter> parser;
-    std::unique_ptr<TSTree, TSTreeDeleter> tree;
-    std::vector<Range> unformattableRanges;
+    // Edits that only changed whitespace, so the tree was moved to match instead of reparsed
+    uint32_t shifts = 0;
+};
 
-    // Returns the index of the element after the split
-    size_t splitAtPosition(uint32_t position);
+class Document {
+private:
+    // The original contents are owned by one of these, or borrowed from the caller
+    std::string ownedOriginal;
+    MappedFile mappedOriginal;
+    std::string_view original;
+
+    // Inserted bytes are copied here, so edits don't have to outlive applyEdits, unless they
+    // are already in a buffer that applyEdits takes over.
+    AddBuffer added;
+
+    // Where the temporary buffers applyEdits needs are allocated. It only serves this document,
+    // so it doesn't lock, and it keeps what is freed to hand out again instead of returning it
+    // to the global heap. Everything it holds is released when the document is reset.
+    std::pmr::unsynchronized_pool_resource scratch;
+
+    // The pieces are kept in a balanced tree so edits and byte offset lookups stay
+    // O(log n) no matter how fragmented the document becomes.
+    PieceTree pieces;
+    LineIndex lines;
+    Range documentRange;
+
+    // Checked once when the contents are loaded. Edits only keep isAscii up to date.
+    Utf8Validation encoding;
+
+    std::unique_ptr<TSParser, TSParserDeleter> parser {ts_parser_new(), ts_parser_delete};
+    std::unique_ptr<TSTree, TSTreeDeleter> tree {nullptr, ts_tree_delete};
+    RangeIndex unformattableRanges;
+
+    // The "format off" and "format on" comments that unformattableRanges is built from.
+    // They are moved along with edits, so after a reparse only the parts of the tree that
+    // changed have to be searched for new ones.
+    struct FormatMarker {
+        uint32_t startByte;
+        uint32_t endByte;
+        bool formatOff;
+    };
+    std::vector<FormatMarker> formatMarkers;
+
+    std::optional<ParseStatistics> statistics;
+
+    struct Borrowed {};
+    Document(Borrowed, std::string_view contents);
+
+    void load(const std::filesystem::path& file);
+    void release();
+    bool initialize();
+    bool parseCanStop() const;
 
     static const char* Read(void* payload, uint32_t byte_index, TSPoint position, uint32_t *bytes_read);
 
     void insertBytes(const Position& position, std::string_view bytes);
     void deleteBytes(const Range& range);
 
+    // Joins edits that overlap or touch into one replacement each, then trims the bytes that
+    // the replacement wouldn't change. Edits that change nothing are removed. The inserted
+    // bytes of the edits it returns are all in `added`, or in one of `texts`.
+    std::pmr::vector<Edit> normalizeEdits(const std::vector<Edit>& edits, std::span<const AddBuffer> texts);
+
+    // Applies all of the edits in one pass over the pieces, instead of one at a time
+    void rebuildPieces(std::span<const Edit> edits);
+    void applyToPieces(std::span<const Edit> edits);
+    void editTree(std::span<const Edit> edits);
+
+    // If the edits only add or remove whitespace strictly between tokens, the tree edits that
+    // move the tree to match them. Edits that would empty a gap between tokens or fill an empty
+    // one, that take the only new line out of a gap or add one to a gap without one, or that
+    // insert right after a token could change the tokens, so there aren't any for those. Nor
+    // are there for the whitespace in literals, on a directive's first line, or in a gap with
+    // an escaped new line, which the tree doesn't show as tokens.
+    std::optional<std::pmr::vector<TSInputEdit>> whitespaceTreeEdits(std::span<const Edit> edits);
+
+#ifndef NDEBUG
+    // Whether a full parse of the contents gives the same tree, to check moved trees with
+    bool matchesReparse();
+#endif
+
+    void shiftFormatMarkers(std::span<const Edit> edits);
+    std::optional<FormatMarker> formatMarkerAt(uint32_t byteOffset) const;
+    void rescanFormatMarkers(std::pmr::vector<TSRange> ranges);
+    void buildUnformattableRanges();
+
 public:
+    // The file is memory mapped if possible, rather than read into a buffer. It must not be
+    // changed in place while the document is in use, so WriteDocument replaces the file
+    // instead, which lets the document be written back to the file it was loaded from.
     Document(const std::filesystem::path& file);
     Document(const std::string& contents);
     Document(std::string&& contents);
 
-    void applyEdits(std::vector<Edit> edits);
+    // Uses `contents` as the original contents without copying it. It must outlive the document.
+    static Document FromBorrowedBuffer(std::string_view contents);
+
+    // The pieces point into the document's own buffers, so it can't be copied or moved.
+    Document(const Document&) = delete;
+    Document& operator=(const Document&) = delete;
+
+    // These replace the contents as if the document had been constructed from the new ones,
+    // but keep the parser and the memory the old contents used. When formatting many files,
+    // reusing one document saves setting all of that up again for each file.
+    //
+    // They return false if the contents aren't valid UTF-8, or the parse was stopped by the
+    // timeout or the cancellation flag. The document then has no tree, and must be reset
+    // again before it is used.
+    bool reset(const std::filesystem::path& file);
+    bool reset(std::string&& contents);
+    bool resetToBorrowedBuffer(std::string_view contents);
+
+    // Returns false if the reparse was stopped by the timeout or the cancellation flag, in
+    // which case the edits are undone and the document is left as it was. Edits that only
+    // change the whitespace between tokens don't need a reparse, and can't fail. If the
+    // reparse fails for any other reason, the edits are kept but the document has no tree,
+    // and must be reset before it is used again.
+    bool applyEdits(std::vector<Edit> edits);
+
+    // Takes over `texts`, the buffers the inserted bytes were appended to, instead of copying
+    // the bytes out of them. Inserted bytes that aren't in one of them are copied as usual.
+    bool applyEdits(std::vector<Edit> edits, std::vector<AddBuffer> texts);
+
+    // Limits how long each parse may take. Zero, the default, means no limit.
+    void setParseTimeout(std::chrono::microseconds timeout);
+
+    // Parses stop when `*flag` becomes non-zero, so another thread can cancel them.
+    // Passing nullptr removes the flag.
+    void setCancellationFlag(const std::atomic_size_t* flag);
+
+    // Collecting statistics walks both trees after every reparse, so it is off by default.
+    void collectParseStatistics();
+    const std::optional<ParseStatistics>& parseStatistics() const { return statistics; }
+
+    // Contents that aren't valid UTF-8 aren't parsed, since columns and code points can't be
+    // worked out for them. The document has no tree, and can only be written back unchanged.
+    bool isValidUtf8() const { return !encoding.firstInvalidByte.has_value(); }
+    std::optional<size_t> firstInvalidByte() const { return encoding.firstInvalidByte; }
+
+    // When every byte is ASCII, display columns are the same as columns, so aren't counted
+    bool isAscii() const { return encoding.isAscii; }
 
-    const std::string& originalContents() const;
+    const Position& startPosition() const { return documentRange.start; }
+    const Position& endPosition() const { return documentRange.end; }
+    const Range& range() const { return documentRange; }
+
+    // These match the DocumentSlice functions of the same name.
+    DocumentSlice slice(const Range& subRange) const;
+
+    const PieceTree& contents() const { return pieces; }
+    std::vector<std::string_view> contentsAt(Range subRange) const;
+    std::string contentsAtAsString(Range subRange) const;
+
+    char characterAt(uint32_t bytePosition) const;
+
+    uint32_t lineCount() const { return lines.lineCount(); }
+
+    // The contents of a line, not including its line ending
+    Range lineRange(uint32_t row) const;
+    Position positionAt(uint32_t byteOffset) const;
+
+    // Unlike DocumentSlice, these use the document's line index instead of scanning, and
+    // columns are in bytes, like tree-sitter's. Only '\n' and "\r\n" end a line.
+    Range nextNewLine(Position start) const;
+
+    Range toNextNewLine(Position start) const;
+    Range toPreviousNewLine(Position end) const;
+
+    // The column `position` is shown at, which counts code points rather than bytes. Lines are
+    // measured this way against the style's line length.
+    uint32_t displayColumn(const Position& position) const;
+
+    std::string toString() const;
+
+    std::string_view originalContents() const { return original; }
     const std::string_view originalContentsAt(const Range& range) const;
 
     // Returns whether the input range contains any unformattable ranges, or
@@ -55,9 +225,19 @@ public:
 
     bool isWithinAnUnformattableRange(const Position& position) const;
 
+    // Answers the same questions faster when they are asked in document order. It is only
+    // valid until the next applyEdits.
+    RangeIndex::Cursor unformattableRangeCursor() const { return unformattableRanges.cursor(); }
+
     TSNode root() const;
 
+    // A copy of the tree for another thread to walk. A tree can't be used by more than one
+    // thread at a time, but copies share their nodes, so they are cheap to make.
+    std::unique_ptr<TSTree, TSTreeDeleter> copyTree() const;
+
     TSInput inputReader();
 };
 
+std::ostream& operator<<(std::ostream& out, const Document& document);
+
 }
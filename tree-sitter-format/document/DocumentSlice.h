@@ -3,36 +3,41 @@
 #include <string_view>
 #include <vector>
 
+#include <tree-sitter-format/document/PieceAlgorithms.h>
+#include <tree-sitter-format/document/PieceTree.h>
 #include <tree-sitter-format/document/Position.h>
 #include <tree-sitter-format/document/Range.h>
 #include <tree-sitter-format/document/UnicodeIterator.h>
 
 namespace tree_sitter_format {
 
+// A view of part of a document. It refers to the document's pieces by where the slice starts
+// in them, so making one, or slicing one further, doesn't copy anything. Like the iterators
+// it hands out, it is only valid until the document is edited.
 class DocumentSlice {
-protected:
-    Range elementRange;
-    std::vector<std::string_view> elements;
-    size_t length;
+private:
+    const PieceTree* pieces;
+    Range sliceRange;
 
-    DocumentSlice() = default;
-
-    Location findByteLocation(uint32_t position) const;
+    // The piece containing the first byte of the slice, and how far into it that byte is
+    PieceTree::Location first;
 
 public:
+    DocumentSlice(const PieceTree& pieces, const Range& range);
 
-
-    DocumentSlice(const Range& range, std::vector<std::string_view> elements);
-
-    const Position& startPosition() const { return elementRange.start; }
-    const Position& endPosition() const { return elementRange.end; }
-    const Range& range() const { return elementRange; }
+    const Position& startPosition() const { return sliceRange.start; }
+    const Position& endPosition() const { return sliceRange.end; }
+    const Range& range() const { return sliceRange; }
 
     DocumentSlice slice(const Range& subRange) const;
     DocumentSlice trimFront() const;
     DocumentSlice trimBack() const;
 
-    const std::vector<std::string_view>& contents() const { return elements;}
+    // Calls `visit` with each part of a piece that makes up the slice, in order
+    template<typename VISITOR>
+    void visitContents(VISITOR&& visit) const;
+
+    std::vector<std::string_view> contents() const;
     std::vector<std::string_view> contentsAt(Range subRange) const;
     std::string contentsAtAsString(Range subRange) const;
 
@@ -52,6 +57,11 @@ public:
     std::string toString() const;
 };
 
+template<typename VISITOR>
+void DocumentSlice::visitContents(VISITOR&& visit) const {
+    VisitPieces(first.piece, first.offset, sliceRange.byteCount(), visit);
+}
+
 std::ostream& operator<<(std::ostream& out, const DocumentSlice& document);
 
 }
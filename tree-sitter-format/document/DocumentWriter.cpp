@@ -0,0 +1,187 @@
+#include <tree-sitter-format/document/DocumentWriter.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <optional>
+#include <string>
+#include <system_error>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <process.h>
+#include <sys/stat.h>
+#else
+#include <array>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // Used to name temporary files, so that two processes writing the same file don't collide
+    int ProcessId() {
+#ifdef _WIN32
+        return _getpid();
+#else
+        return int(getpid());
+#endif
+    }
+
+#ifdef _WIN32
+    bool WritePieces(int fileDescriptor, const tree_sitter_format::Document& document) {
+        // There is no scatter-gather write for file descriptors on Windows
+        for (std::string_view piece : document.contents()) {
+            while (!piece.empty()) {
+                unsigned int count = unsigned(std::min(piece.size(), size_t(INT_MAX)));
+                int written = _write(fileDescriptor, piece.data(), count);
+                if (written < 0) {
+                    return false;
+                }
+
+                piece.remove_prefix(size_t(written));
+            }
+        }
+
+        return true;
+    }
+#else
+#ifdef IOV_MAX
+    constexpr size_t BatchSize = IOV_MAX;
+#else
+    constexpr size_t BatchSize = 1024;
+#endif
+
+    bool WriteBatch(int fileDescriptor, iovec* pieces, size_t count) {
+        while (count > 0) {
+            ssize_t written = writev(fileDescriptor, pieces, int(count));
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                return false;
+            }
+
+            // Skip the pieces that were written completely, then the part of the next one
+            // that was, and write the rest.
+            size_t remaining = size_t(written);
+            while (count > 0 && remaining >= pieces->iov_len) {
+                remaining -= pieces->iov_len;
+                pieces++;
+                count--;
+            }
+
+            if (count > 0) {
+                pieces->iov_base = static_cast<char*>(pieces->iov_base) + remaining;
+                pieces->iov_len -= remaining;
+            }
+        }
+
+        return true;
+    }
+
+    bool WritePieces(int fileDescriptor, const tree_sitter_format::Document& document) {
+        std::array<iovec, BatchSize> batch;
+        size_t count = 0;
+
+        for (std::string_view piece : document.contents()) {
+            batch[count++] = iovec {
+                .iov_base = const_cast<char*>(piece.data()),
+                .iov_len = piece.size(),
+            };
+
+            if (count == batch.size()) {
+                if (!WriteBatch(fileDescriptor, batch.data(), count)) {
+                    return false;
+                }
+
+                count = 0;
+            }
+        }
+
+        return WriteBatch(fileDescriptor, batch.data(), count);
+    }
+#endif
+}
+
+namespace tree_sitter_format {
+
+    bool WriteDocument(int fileDescriptor, const Document& document) {
+        return WritePieces(fileDescriptor, document);
+    }
+
+    bool WriteDocument(const std::filesystem::path& file, const Document& document) {
+        // The document may be reading its contents from this very file, through a memory
+        // mapping. Truncating the file would take the contents away while they are being
+        // written, so they are written to a new file next to it, which then replaces it.
+        //
+        // A link is followed, so the file it points to is replaced rather than the link. A file
+        // that doesn't exist yet gets the permissions new files are created with.
+        std::error_code error;
+        std::filesystem::path target = file;
+        if (std::filesystem::is_symlink(std::filesystem::symlink_status(file, error))) {
+            target = std::filesystem::canonical(file, error);
+            if (error) {
+                errno = error.value();
+                return false;
+            }
+        }
+
+        std::optional<std::filesystem::perms> permissions;
+        std::filesystem::file_status status = std::filesystem::status(target, error);
+        if (std::filesystem::exists(status)) {
+            permissions = status.permissions();
+        }
+
+        error.clear();
+
+        std::filesystem::path temporary;
+        int fileDescriptor = -1;
+        for (uint32_t attempt = 0; fileDescriptor < 0; attempt++) {
+            temporary = target;
+            temporary += ".tsf-" + std::to_string(ProcessId()) + "-" + std::to_string(attempt);
+#ifdef _WIN32
+            fileDescriptor = _wopen(temporary.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+            fileDescriptor = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+#endif
+            if (fileDescriptor < 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+
+        bool written = WritePieces(fileDescriptor, document);
+        int writeError = written ? 0 : errno;
+
+#ifdef _WIN32
+        written = _close(fileDescriptor) == 0 && written;
+#else
+        written = close(fileDescriptor) == 0 && written;
+#endif
+        if (written) {
+            if (permissions.has_value()) {
+                std::filesystem::permissions(temporary, permissions.value(), error);
+            }
+
+            if (!error) {
+                std::filesystem::rename(temporary, target, error);
+            }
+
+            if (!error) {
+                return true;
+            }
+
+            writeError = error.value();
+        } else if (writeError == 0) {
+            writeError = errno;
+        }
+
+        // Keep the reason the write failed, rather than whatever removing the file sets
+        std::filesystem::remove(temporary, error);
+        errno = writeError;
+        return false;
+    }
+
+}
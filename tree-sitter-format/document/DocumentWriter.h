@@ -0,0 +1,22 @@
+#pragma once
+
+#include <tree-sitter-format/document/Document.h>
+
+#include <filesystem>
+
+namespace tree_sitter_format {
+
+// These write the document's pieces straight to the file, without first joining them into
+// one buffer. On POSIX systems the pieces are handed to writev in batches of up to IOV_MAX,
+// so even a very fragmented document only takes a few system calls.
+//
+// They return false if the file can't be opened or written to, and errno says why.
+bool WriteDocument(int fileDescriptor, const Document& document);
+
+// The contents are written to a new file in the same directory, which is then renamed over
+// `file`, keeping its permissions. A document loaded from `file` can be written back to it
+// this way, since its mapping of the old file stays valid. If the write fails, `file` is
+// left as it was.
+bool WriteDocument(const std::filesystem::path& file, const Document& document);
+
+}
@@ -0,0 +1,131 @@
+#include <tree-sitter-format/document/EditMerger.h>
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+namespace tree_sitter_format {
+
+    bool EditMerger::conflicts(const Edit& edit) const {
+        if (const DeleteEdit* d = std::get_if<DeleteEdit>(&edit)) {
+            uint32_t start = d->range.start.byteOffset;
+            uint32_t end = d->range.end.byteOffset;
+            if (start == end) {
+                return false;
+            }
+
+            // A delete that starts before this one's end and ends after its start
+            auto after = deleted.lower_bound(end);
+            if (after != deleted.begin() && std::prev(after)->second > start) {
+                return true;
+            }
+
+            // An insert strictly inside it
+            auto insert = inserted.upper_bound(start);
+            return insert != inserted.end() && *insert < end;
+        }
+
+        uint32_t position = std::get<InsertEdit>(edit).position.byteOffset;
+        if (inserted.contains(position)) {
+            return true;
+        }
+
+        // A delete that starts before the position and ends after it
+        auto after = deleted.lower_bound(position);
+        return after != deleted.begin() && std::prev(after)->second > position;
+    }
+
+    void EditMerger::addDelete(uint32_t start, uint32_t end) {
+        // Join the deletes this one overlaps. Deletes from one group can overlap each other.
+        auto next = deleted.upper_bound(start);
+        if (next != deleted.begin() && std::prev(next)->second > start) {
+            --next;
+            start = next->first;
+        }
+
+        while (next != deleted.end() && next->first < end) {
+            end = std::max(end, next->second);
+            next = deleted.erase(next);
+        }
+
+        deleted.emplace(start, end);
+    }
+
+    bool EditMerger::add(std::span<const Edit> edits) {
+        for (const Edit& edit : edits) {
+            if (conflicts(edit)) {
+                return false;
+            }
+        }
+
+        for (const Edit& edit : edits) {
+            if (const DeleteEdit* d = std::get_if<DeleteEdit>(&edit)) {
+                if (d->range.start.byteOffset < d->range.end.byteOffset) {
+                    addDelete(d->range.start.byteOffset, d->range.end.byteOffset);
+                }
+            } else {
+                inserted.insert(std::get<InsertEdit>(edit).position.byteOffset);
+            }
+        }
+
+        merged.insert(merged.end(), edits.begin(), edits.end());
+        return true;
+    }
+
+    std::vector<Edit> EditMerger::take() {
+        deleted.clear();
+        inserted.clear();
+        return std::exchange(merged, {});
+    }
+
+    void RebaseOffsets(std::span<RebasedOffset> offsets, std::span<const Edit> edits) {
+        assert(std::ranges::is_sorted(edits));
+
+        // The edits are sorted from the end of the document to the start, so they are walked
+        // backwards. Deletes can overlap each other, so the deleted bytes are joined before they
+        // are counted, the way the document joins them when it applies them. A delete that
+        // reaches past an offset has the rest of its bytes counted for the offsets after it.
+        auto edit = edits.rbegin();
+        int64_t inserted = 0;
+        int64_t deleted = 0;
+        uint32_t countedUpTo = 0;
+        uint32_t deletedUpTo = 0;
+
+        for (RebasedOffset& offset : offsets) {
+            uint32_t byteOffset = offset.byteOffset;
+            if (deletedUpTo > countedUpTo) {
+                deleted += std::min(deletedUpTo, byteOffset) - countedUpTo;
+                countedUpTo = std::min(deletedUpTo, byteOffset);
+            }
+
+            for (; edit != edits.rend(); ++edit) {
+                if (const DeleteEdit* d = std::get_if<DeleteEdit>(&*edit)) {
+                    uint32_t start = d->range.start.byteOffset;
+                    uint32_t end = d->range.end.byteOffset;
+                    if (start >= byteOffset) {
+                        break;
+                    }
+
+                    start = std::max(start, countedUpTo);
+                    if (std::min(end, byteOffset) > start) {
+                        deleted += std::min(end, byteOffset) - start;
+                        countedUpTo = std::min(end, byteOffset);
+                    }
+
+                    deletedUpTo = std::max(deletedUpTo, end);
+                } else {
+                    const InsertEdit& i = std::get<InsertEdit>(*edit);
+                    uint32_t position = i.position.byteOffset;
+                    if (position > byteOffset || (position == byteOffset && offset.insertsAfter)) {
+                        break;
+                    }
+
+                    inserted += int64_t(i.bytes.size());
+                }
+            }
+
+            offset.byteOffset = uint32_t(int64_t(byteOffset) + inserted - deleted);
+        }
+    }
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <tree-sitter-format/document/Edits.h>
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <span>
+#include <vector>
+
+namespace tree_sitter_format {
+
+// Gathers the edits that several traversers made against the same version of a document into
+// one set, so they can all be applied with one reparse. They are all in that version's byte
+// offsets, which is what Document::applyEdits takes, so none of them have to be moved. Only
+// edits that conflict have to be decided between, and the edits added first win.
+//
+// Edits conflict when they change the same bytes, when one inserts inside what another
+// deletes, or when both insert at the same position, since the order those end up in is only
+// meaningful when they come from the same traverser. Edits that only touch don't conflict.
+// The document joins them into one replacement, which does what each of them meant.
+class EditMerger {
+private:
+    // The bytes deleted, as [start, end) by start. Deletes that overlap are joined.
+    std::map<uint32_t, uint32_t> deleted;
+    std::set<uint32_t> inserted;
+
+    std::vector<Edit> merged;
+
+    bool conflicts(const Edit& edit) const;
+    void addDelete(uint32_t start, uint32_t end);
+
+public:
+    // Adds a group of edits, which stand or fall together, unless any of them conflict with the
+    // edits already added, in which case none of them are. The edits of a group may overlap
+    // each other. Part of a traverser's edits could leave the document in a state the traverser
+    // never meant, like a bracket without the one that closes it, so those are added as one group.
+    bool add(std::span<const Edit> edits);
+
+    bool empty() const { return merged.empty(); }
+
+    // Returns the merged edits, leaving the merger empty to start again
+    std::vector<Edit> take();
+};
+
+// An offset of a document to follow through edits, so that ranges of the document can be
+// kept up to date. Inserts at the offset itself are put after it when `insertsAfter` is set,
+// like for the start of a range, and before it otherwise. An offset that was deleted moves to
+// where the deleted bytes were.
+struct RebasedOffset {
+    uint32_t byteOffset;
+    bool insertsAfter;
+};
+
+// Moves each offset to where it is once `edits` have been applied, in one walk over both. The
+// offsets must be in ascending order, and the edits sorted the way Document::applyEdits sorts
+// them, which std::ranges::stable_sort does.
+void RebaseOffsets(std::span<RebasedOffset> offsets, std::span<const Edit> edits);
+
+}
@@ -14,6 +14,9 @@ struct DeleteEdit {
 
 struct InsertEdit {
     Position position;
+
+    // The document copies these when the edit is applied, so they only need to
+    // live until then.
     std::string_view bytes;
 };
 
@@ -0,0 +1,68 @@
+#include <tree-sitter-format/document/LineIndex.h>
+
+#include <algorithm>
+
+namespace tree_sitter_format {
+
+    void LineIndex::assign(std::string_view contents) {
+        lineStarts.assign(1, 0);
+
+        for (size_t newLine = contents.find('\n'); newLine != std::string_view::npos; newLine = contents.find('\n', newLine + 1)) {
+            lineStarts.push_back(uint32_t(newLine + 1));
+        }
+    }
+
+    void LineIndex::update(std::span<const Edit> edits, std::pmr::memory_resource* scratch) {
+        // The edits are sorted from the end of the document to the start, so walking them
+        // backwards lets the new table be built in one pass over the old one, instead of
+        // shifting every following line start for each edit.
+        std::pmr::vector<uint32_t> updated(scratch);
+        updated.reserve(lineStarts.size());
+
+        size_t next = 0;
+        int64_t delta = 0;
+
+        auto copyUpTo = [&](uint32_t byteOffset) {
+            while (next < lineStarts.size() && lineStarts[next] <= byteOffset) {
+                updated.push_back(uint32_t(lineStarts[next] + delta));
+                next++;
+            }
+        };
+
+        for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit) {
+            if (const DeleteEdit* d = std::get_if<DeleteEdit>(&*edit)) {
+                uint32_t start = d->range.start.byteOffset;
+                uint32_t end = d->range.end.byteOffset;
+
+                copyUpTo(start);
+
+                // These lines started after a new line that has been deleted
+                while (next < lineStarts.size() && lineStarts[next] <= end) {
+                    next++;
+                }
+
+                delta -= end - start;
+            } else if (const InsertEdit* i = std::get_if<InsertEdit>(&*edit)) {
+                uint32_t position = i->position.byteOffset;
+                std::string_view bytes = i->bytes;
+
+                copyUpTo(position);
+
+                for (size_t newLine = bytes.find('\n'); newLine != std::string_view::npos; newLine = bytes.find('\n', newLine + 1)) {
+                    updated.push_back(uint32_t(position + delta + newLine + 1));
+                }
+
+                delta += bytes.size();
+            }
+        }
+
+        copyUpTo(UINT32_MAX);
+        lineStarts.assign(updated.begin(), updated.end());
+    }
+
+    uint32_t LineIndex::rowAt(uint32_t byteOffset) const {
+        auto line = std::upper_bound(lineStarts.begin(), lineStarts.end(), byteOffset);
+        return uint32_t(line - lineStarts.begin() - 1);
+    }
+
+}
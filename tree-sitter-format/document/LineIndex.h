@@ -0,0 +1,36 @@
+#pragma once
+
+#include <tree-sitter-format/document/Edits.h>
+
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace tree_sitter_format {
+
+// The byte offset that each line of a document starts at. Lines are separated by '\n',
+// the same as tree-sitter counts rows, so a TSPoint's row indexes straight into it.
+class LineIndex {
+private:
+    // Always starts with 0, for the first line
+    std::vector<uint32_t> lineStarts = {0};
+
+public:
+    void assign(std::string_view contents);
+
+    // Moves the line starts to account for edits that have just been applied to the
+    // document. The edits must be sorted the way Document::applyEdits sorts them, and
+    // be in the coordinates of the document before any of them were applied. The new
+    // table is built in `scratch` before being copied over the old one.
+    void update(std::span<const Edit> edits, std::pmr::memory_resource* scratch = std::pmr::get_default_resource());
+
+    uint32_t lineCount() const { return uint32_t(lineStarts.size()); }
+    uint32_t lineStart(uint32_t row) const { return lineStarts[row]; }
+
+    // Returns the row containing the byte at `byteOffset`
+    uint32_t rowAt(uint32_t byteOffset) const;
+};
+
+}
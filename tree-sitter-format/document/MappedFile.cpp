@@ -0,0 +1,122 @@
+#include <tree-sitter-format/document/MappedFile.h>
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace tree_sitter_format {
+
+    MappedFile::~MappedFile() {
+        unmap();
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept
+        : bytes(std::exchange(other.bytes, nullptr)), size(std::exchange(other.size, 0)) {}
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            unmap();
+            bytes = std::exchange(other.bytes, nullptr);
+            size = std::exchange(other.size, 0);
+        }
+
+        return *this;
+    }
+
+#ifdef _WIN32
+
+    void MappedFile::unmap() {
+        if (bytes != nullptr) {
+            UnmapViewOfFile(bytes);
+            bytes = nullptr;
+            size = 0;
+        }
+    }
+
+    std::optional<MappedFile> MappedFile::Map(const std::filesystem::path& file) {
+        HANDLE handle = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle == INVALID_HANDLE_VALUE) {
+            return std::nullopt;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(handle, &fileSize) || GetFileType(handle) != FILE_TYPE_DISK) {
+            CloseHandle(handle);
+            return std::nullopt;
+        }
+
+        // Empty files can't be mapped, but there is nothing to map anyway
+        if (fileSize.QuadPart == 0) {
+            CloseHandle(handle);
+            return MappedFile();
+        }
+
+        HANDLE mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(handle);
+        if (mapping == nullptr) {
+            return std::nullopt;
+        }
+
+        // The view keeps the mapping alive after its handle is closed
+        const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (view == nullptr) {
+            return std::nullopt;
+        }
+
+        return MappedFile(static_cast<const char*>(view), size_t(fileSize.QuadPart));
+    }
+
+#else
+
+    void MappedFile::unmap() {
+        if (bytes != nullptr) {
+            munmap(const_cast<char*>(bytes), size);
+            bytes = nullptr;
+            size = 0;
+        }
+    }
+
+    std::optional<MappedFile> MappedFile::Map(const std::filesystem::path& file) {
+        int descriptor = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (descriptor < 0) {
+            return std::nullopt;
+        }
+
+        struct stat status;
+        if (fstat(descriptor, &status) != 0 || !S_ISREG(status.st_mode)) {
+            close(descriptor);
+            return std::nullopt;
+        }
+
+        // Empty files can't be mapped, but there is nothing to map anyway
+        if (status.st_size == 0) {
+            close(descriptor);
+            return MappedFile();
+        }
+
+        // The mapping stays valid after the descriptor is closed
+        void* view = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+        close(descriptor);
+        if (view == MAP_FAILED) {
+            return std::nullopt;
+        }
+
+        // The whole file is about to be parsed, so start reading it in now
+        madvise(view, size_t(status.st_size), MADV_WILLNEED);
+
+        return MappedFile(static_cast<const char*>(view), size_t(status.st_size));
+    }
+
+#endif
+
+}
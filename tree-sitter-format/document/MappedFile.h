@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+
+namespace tree_sitter_format {
+
+// A file mapped read only into memory. The OS pages the contents in as they are read,
+// instead of them being copied into a buffer up front. The file must not be written to
+// while it is mapped, so write output to another file and rename it over this one.
+class MappedFile {
+private:
+    const char* bytes = nullptr;
+    size_t size = 0;
+
+    MappedFile(const char* bytes, size_t size) : bytes(bytes), size(size) {}
+
+    void unmap();
+
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Returns nothing if the file can't be mapped, such as when it isn't a regular file.
+    static std::optional<MappedFile> Map(const std::filesystem::path& file);
+
+    std::string_view contents() const { return std::string_view(bytes, size); }
+};
+
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <tree-sitter-format/document/Position.h>
+#include <tree-sitter-format/document/Range.h>
+#include <tree-sitter-format/document/ScanKernels.h>
+
+#include <algorithm>
+#include <cassert>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Scanning routines shared between DocumentSlice and Document. PIECE_ITERATOR can be any
+// bidirectional iterator over std::string_view pieces, like a PieceTree's.
+
+namespace tree_sitter_format {
+
+// Calls `visit` with each part of a piece that makes up the `byteCount` bytes starting
+// `offset` bytes into `piece`.
+template<typename PIECE_ITERATOR, typename VISITOR>
+void VisitPieces(PIECE_ITERATOR piece, size_t offset, uint32_t byteCount, VISITOR&& visit) {
+    while (byteCount > 0) {
+        std::string_view element = piece->substr(offset, byteCount);
+        visit(element);
+
+        byteCount -= uint32_t(element.size());
+        offset = 0;
+        ++piece;
+    }
+}
+
+// Calls `found` with the offset of every occurrence of `needle` in the `byteCount` bytes
+// starting `offset` bytes into `piece`, including occurrences split across pieces. Offsets
+// are relative to the first byte searched.
+template<typename PIECE_ITERATOR, typename VISITOR>
+void FindAll(PIECE_ITERATOR piece, size_t offset, uint32_t byteCount, std::string_view needle, VISITOR&& found) {
+    assert(!needle.empty());
+
+    // The last needle.size() - 1 bytes searched so far. A match can't fit in here, or in the
+    // first needle.size() - 1 bytes of the next piece, so any match in the two joined
+    // together is one that crosses into the next piece.
+    std::string tail;
+    uint32_t position = 0;
+
+    VisitPieces(piece, offset, byteCount, [&](std::string_view element) {
+        if (!tail.empty()) {
+            std::string boundary = tail;
+            boundary.append(element.substr(0, needle.size() - 1));
+
+            for (size_t match = boundary.find(needle); match != std::string::npos; match = boundary.find(needle, match + 1)) {
+                found(uint32_t(position - tail.size() + match));
+            }
+        }
+
+        // std::string_view::find looks for the first character with memchr, which is
+        // vectorized by the standard libraries we build with.
+        for (size_t match = element.find(needle); match != std::string_view::npos; match = element.find(needle, match + 1)) {
+            found(uint32_t(position + match));
+        }
+
+        tail.append(element.substr(element.size() - std::min(element.size(), needle.size() - 1)));
+        if (tail.size() >= needle.size()) {
+            tail.erase(0, tail.size() - (needle.size() - 1));
+        }
+
+        position += uint32_t(element.size());
+    });
+}
+
+// Finds the first unescaped new line at or after `start`, which is `offset` bytes into `piece`,
+// looking at no more than `byteCount` bytes. If there is no new line before `end` or the byte
+// limit, the returned range is empty and positioned where the search stopped. Columns are in
+// bytes, like tree-sitter's and the document's line index.
+template<typename PIECE_ITERATOR>
+Range NextNewLine(PIECE_ITERATOR piece, PIECE_ITERATOR end, size_t offset, uint32_t byteCount, Position start) {
+    uint32_t column = start.location.column;
+    uint32_t byteOffset = start.byteOffset;
+
+    std::optional<Position> newLineStart;
+
+    bool previousCharacterWasEscape = false;
+
+    uint32_t endByteOffset = start.byteOffset + byteCount;
+    for (; piece != end && byteOffset < endByteOffset; ++piece, offset = 0) {
+        std::string_view element = std::string_view(*piece).substr(offset, endByteOffset - byteOffset);
+
+        while (!element.empty()) {
+            // Everything up to the next line break or escape only moves the column along. Any
+            // byte in there also ends an escape.
+            if (!newLineStart.has_value()) {
+                size_t skipped = FindLineBreakOrEscape(element);
+
+                if (skipped > 0) {
+                    previousCharacterWasEscape = false;
+                }
+
+                column += uint32_t(skipped);
+                byteOffset += uint32_t(skipped);
+                element.remove_prefix(skipped);
+
+                if (element.empty()) {
+                    break;
+                }
+            }
+
+            char character = element.front();
+
+            if (newLineStart.has_value()) {
+                if (character != '\n') {
+                    Position newLineEnd {
+                        .location = TSPoint {
+                            .row = start.location.row + 1,
+                            .column = 0,
+                        },
+                        .byteOffset = byteOffset,
+                    };
+
+                    return Range {
+                        .start = newLineStart.value(),
+                        .end = newLineEnd,
+                    };
+                }
+            }
+
+            bool isVerticalWhitespace = character == '\r' || character == '\n';
+            if (!previousCharacterWasEscape && isVerticalWhitespace) {
+                newLineStart = Position {
+                    .location = TSPoint {
+                        .row = start.location.row,
+                        .column = column,
+                    },
+                    .byteOffset = byteOffset,
+                };
+
+                // If the character is a line feed, we are done. If it is
+                // a carriage return, we need to keep going to find the
+                // line feed character.
+                if (character == '\n') {
+                    Position newLineEnd {
+                        .location = TSPoint {
+                            .row = start.location.row + 1,
+                            .column = 0,
+                        },
+                        .byteOffset = byteOffset + 1,
+                    };
+
+                    return Range {
+                        .start = newLineStart.value(),
+                        .end = newLineEnd,
+                    };
+                }
+            }
+
+            previousCharacterWasEscape = !previousCharacterWasEscape && character == '\\';
+            column++;
+            byteOffset++;
+            element.remove_prefix(1);
+        }
+    }
+
+    Position endOfFilePosition {
+        .location = TSPoint {
+            .row = start.location.row,
+            .column = column,
+        },
+        .byteOffset = byteOffset,
+    };
+
+    return Range {
+        .start = endOfFilePosition,
+        .end = endOfFilePosition,
+    };
+}
+
+}
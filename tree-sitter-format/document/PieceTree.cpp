@@ -0,0 +1,290 @@
+#include <tree-sitter-format/document/PieceTree.h>
+
+#include <cassert>
+
+namespace tree_sitter_format {
+
+    uint32_t PieceTree::nextPriority() {
+        // xorshift32, the priorities only need to be well distributed, not unpredictable.
+        randomState ^= randomState << 13;
+        randomState ^= randomState >> 17;
+        randomState ^= randomState << 5;
+        return randomState;
+    }
+
+    PieceTree::NodeIndex PieceTree::allocate(std::string_view piece) {
+        Node node {
+            .piece = piece,
+            .subtreeLength = uint32_t(piece.size()),
+            .subtreeCount = 1,
+            .priority = nextPriority(),
+            .left = NullNode,
+            .right = NullNode,
+            .parent = NullNode,
+        };
+
+        if (!freeNodes.empty()) {
+            NodeIndex index = freeNodes.back();
+            freeNodes.pop_back();
+
+            nodes[index] = node;
+            return index;
+        }
+
+        nodes.push_back(node);
+        return NodeIndex(nodes.size() - 1);
+    }
+
+    void PieceTree::release(NodeIndex subtree) {
+        if (subtree == NullNode) {
+            return;
+        }
+
+        // Walk the subtree with an explicit stack, it may be too deep to recurse over safely
+        // if a large part of the document is being deleted.
+        std::vector<NodeIndex> pending = {subtree};
+        while (!pending.empty()) {
+            NodeIndex node = pending.back();
+            pending.pop_back();
+
+            if (nodes[node].left != NullNode) {
+                pending.push_back(nodes[node].left);
+            }
+            if (nodes[node].right != NullNode) {
+                pending.push_back(nodes[node].right);
+            }
+
+            freeNodes.push_back(node);
+        }
+    }
+
+    void PieceTree::update(NodeIndex node) {
+        Node& n = nodes[node];
+        n.subtreeLength = subtreeLength(n.left) + uint32_t(n.piece.size()) + subtreeLength(n.right);
+        n.subtreeCount = subtreeCount(n.left) + 1 + subtreeCount(n.right);
+
+        if (n.left != NullNode) {
+            nodes[n.left].parent = node;
+        }
+        if (n.right != NullNode) {
+            nodes[n.right].parent = node;
+        }
+    }
+
+    std::pair<PieceTree::NodeIndex, PieceTree::NodeIndex> PieceTree::split(NodeIndex node, uint32_t offset) {
+        if (node == NullNode) {
+            return {NullNode, NullNode};
+        }
+
+        uint32_t leftLength = subtreeLength(nodes[node].left);
+        uint32_t pieceLength = uint32_t(nodes[node].piece.size());
+
+        if (offset <= leftLength) {
+            auto [before, after] = split(nodes[node].left, offset);
+            nodes[node].left = after;
+            update(node);
+
+            if (before != NullNode) {
+                nodes[before].parent = NullNode;
+            }
+            return {before, node};
+        }
+
+        if (offset >= leftLength + pieceLength) {
+            auto [before, after] = split(nodes[node].right, offset - leftLength - pieceLength);
+            nodes[node].right = before;
+            update(node);
+
+            if (after != NullNode) {
+                nodes[after].parent = NullNode;
+            }
+            return {node, after};
+        }
+
+        // The split point is in the middle of this node's piece, so the end of the piece
+        // becomes a new node that starts the right hand tree.
+        uint32_t pieceOffset = offset - leftLength;
+        NodeIndex remainder = allocate(nodes[node].piece.substr(pieceOffset));
+        nodes[node].piece.remove_suffix(nodes[node].piece.size() - pieceOffset);
+
+        NodeIndex after = nodes[node].right;
+        if (after != NullNode) {
+            nodes[after].parent = NullNode;
+        }
+
+        nodes[node].right = NullNode;
+        update(node);
+
+        return {node, merge(remainder, after)};
+    }
+
+    PieceTree::NodeIndex PieceTree::merge(NodeIndex left, NodeIndex right) {
+        if (left == NullNode) {
+            return right;
+        }
+
+        if (right == NullNode) {
+            return left;
+        }
+
+        if (nodes[left].priority >= nodes[right].priority) {
+            nodes[left].right = merge(nodes[left].right, right);
+            update(left);
+            nodes[left].parent = NullNode;
+            return left;
+        } else {
+            nodes[right].left = merge(left, nodes[right].left);
+            update(right);
+            nodes[right].parent = NullNode;
+            return right;
+        }
+    }
+
+    PieceTree::NodeIndex PieceTree::leftmost(NodeIndex node) const {
+        if (node == NullNode) {
+            return NullNode;
+        }
+
+        while (nodes[node].left != NullNode) {
+            node = nodes[node].left;
+        }
+
+        return node;
+    }
+
+    PieceTree::NodeIndex PieceTree::rightmost(NodeIndex node) const {
+        if (node == NullNode) {
+            return NullNode;
+        }
+
+        while (nodes[node].right != NullNode) {
+            node = nodes[node].right;
+        }
+
+        return node;
+    }
+
+    PieceTree::NodeIndex PieceTree::successor(NodeIndex node) const {
+        if (nodes[node].right != NullNode) {
+            return leftmost(nodes[node].right);
+        }
+
+        NodeIndex parent = nodes[node].parent;
+        while (parent != NullNode && nodes[parent].right == node) {
+            node = parent;
+            parent = nodes[node].parent;
+        }
+
+        return parent;
+    }
+
+    PieceTree::NodeIndex PieceTree::predecessor(NodeIndex node) const {
+        // Decrementing the end iterator gives the last piece
+        if (node == NullNode) {
+            return rightmost(root);
+        }
+
+        if (nodes[node].left != NullNode) {
+            return rightmost(nodes[node].left);
+        }
+
+        NodeIndex parent = nodes[node].parent;
+        while (parent != NullNode && nodes[parent].left == node) {
+            node = parent;
+            parent = nodes[node].parent;
+        }
+
+        return parent;
+    }
+
+    PieceTree::const_iterator& PieceTree::const_iterator::operator++() {
+        node = tree->successor(node);
+        return *this;
+    }
+
+    PieceTree::const_iterator PieceTree::const_iterator::operator++(int) {
+        const_iterator original = *this;
+        ++(*this);
+        return original;
+    }
+
+    PieceTree::const_iterator& PieceTree::const_iterator::operator--() {
+        node = tree->predecessor(node);
+        return *this;
+    }
+
+    PieceTree::const_iterator PieceTree::const_iterator::operator--(int) {
+        const_iterator original = *this;
+        --(*this);
+        return original;
+    }
+
+    void PieceTree::assign(std::string_view piece) {
+        assign(&piece, &piece + 1);
+    }
+
+    void PieceTree::clear() {
+        nodes.clear();
+        freeNodes.clear();
+        root = NullNode;
+    }
+
+    PieceTree::Location PieceTree::find(uint32_t offset) const {
+        assert(offset <= length());
+
+        NodeIndex node = root;
+        while (node != NullNode) {
+            uint32_t leftLength = subtreeLength(nodes[node].left);
+            uint32_t pieceLength = uint32_t(nodes[node].piece.size());
+
+            if (offset < leftLength) {
+                node = nodes[node].left;
+            } else if (offset < leftLength + pieceLength) {
+                return Location {
+                    .piece = const_iterator(this, node),
+                    .offset = offset - leftLength,
+                };
+            } else {
+                offset -= leftLength + pieceLength;
+                node = nodes[node].right;
+            }
+        }
+
+        return Location {
+            .piece = end(),
+            .offset = 0,
+        };
+    }
+
+    void PieceTree::insert(uint32_t offset, std::string_view bytes) {
+        assert(offset <= length());
+
+        if (bytes.empty()) {
+            return;
+        }
+
+        auto [before, after] = split(root, offset);
+        NodeIndex inserted = allocate(bytes);
+
+        root = merge(merge(before, inserted), after);
+        nodes[root].parent = NullNode;
+    }
+
+    void PieceTree::erase(uint32_t offset, uint32_t count) {
+        assert(offset <= length());
+
+        if (count == 0) {
+            return;
+        }
+
+        auto [before, rest] = split(root, offset);
+        auto [erased, after] = split(rest, count);
+        release(erased);
+
+        root = merge(before, after);
+        if (root != NullNode) {
+            nodes[root].parent = NullNode;
+        }
+    }
+
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace tree_sitter_format {
+
+// A balanced tree of pieces, ordered by where they appear in the document. Every
+// node records the byte length of its subtree, so finding the piece that contains
+// a byte offset, inserting bytes, and deleting bytes are all O(log n) in the number
+// of pieces.
+//
+// The tree is a treap (https://en.wikipedia.org/wiki/Treap) keyed implicitly by
+// position. Nodes live in a single vector and refer to each other by index, so
+// growing the tree doesn't allocate once the vector has reached its peak size.
+class PieceTree {
+private:
+    using NodeIndex = uint32_t;
+    static constexpr NodeIndex NullNode = UINT32_MAX;
+
+    struct Node {
+        std::string_view piece;
+
+        uint32_t subtreeLength;
+        uint32_t subtreeCount;
+        uint32_t priority;
+
+        NodeIndex left;
+        NodeIndex right;
+        NodeIndex parent;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<NodeIndex> freeNodes;
+    NodeIndex root = NullNode;
+    uint32_t randomState = 0x9E3779B9;
+
+    uint32_t nextPriority();
+
+    NodeIndex allocate(std::string_view piece);
+    void release(NodeIndex subtree);
+
+    uint32_t subtreeLength(NodeIndex node) const { return node == NullNode ? 0 : nodes[node].subtreeLength; }
+    uint32_t subtreeCount(NodeIndex node) const { return node == NullNode ? 0 : nodes[node].subtreeCount; }
+    void update(NodeIndex node);
+
+    // Splits the subtree into the nodes covering the first `offset` bytes and the
+    // nodes covering the rest. A piece straddling `offset` is split in two.
+    std::pair<NodeIndex, NodeIndex> split(NodeIndex node, uint32_t offset);
+    NodeIndex merge(NodeIndex left, NodeIndex right);
+
+    NodeIndex leftmost(NodeIndex node) const;
+    NodeIndex rightmost(NodeIndex node) const;
+    NodeIndex successor(NodeIndex node) const;
+    NodeIndex predecessor(NodeIndex node) const;
+
+public:
+    class const_iterator {
+    private:
+        friend class PieceTree;
+
+        const PieceTree* tree = nullptr;
+        NodeIndex node = NullNode;
+
+        const_iterator(const PieceTree* tree, NodeIndex node) : tree(tree), node(node) {}
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::string_view*;
+        using reference = const std::string_view&;
+
+        const_iterator() = default;
+
+        reference operator*() const { return tree->nodes[node].piece; }
+        pointer operator->() const { return &tree->nodes[node].piece; }
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+        bool operator==(const const_iterator& other) const { return tree == other.tree && node == other.node; }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+    };
+
+    struct Location {
+        const_iterator piece;
+        uint32_t offset;
+    };
+
+    PieceTree() = default;
+
+    // Replaces the contents of the tree with the given pieces in O(n). Empty pieces are skipped.
+    template<typename PIECE_ITERATOR>
+    void assign(PIECE_ITERATOR first, PIECE_ITERATOR last);
+    void assign(std::string_view piece);
+    void clear();
+
+    uint32_t length() const { return subtreeLength(root); }
+    size_t size() const { return subtreeCount(root); }
+    bool empty() const { return root == NullNode; }
+
+    const_iterator begin() const { return const_iterator(this, leftmost(root)); }
+    const_iterator end() const { return const_iterator(this, NullNode); }
+
+    // Returns the piece containing the byte at `offset`, and how far into the piece
+    // that byte is. If `offset` is the length of the tree, returns end().
+    Location find(uint32_t offset) const;
+
+    void insert(uint32_t offset, std::string_view bytes);
+    void erase(uint32_t offset, uint32_t count);
+};
+
+template<typename PIECE_ITERATOR>
+void PieceTree::assign(PIECE_ITERATOR first, PIECE_ITERATOR last) {
+    clear();
+
+    // Build a Cartesian tree over the pieces in order, which is a valid treap when the
+    // priorities are random. The stack holds the right spine of the tree built so far.
+    std::vector<NodeIndex> spine;
+    for (; first != last; ++first) {
+        std::string_view piece = *first;
+        if (piece.empty()) {
+            continue;
+        }
+
+        NodeIndex node = allocate(piece);
+        NodeIndex lastPopped = NullNode;
+        while (!spine.empty() && nodes[spine.back()].priority < nodes[node].priority) {
+            lastPopped = spine.back();
+            spine.pop_back();
+            update(lastPopped);
+        }
+
+        nodes[node].left = lastPopped;
+        if (!spine.empty()) {
+            nodes[spine.back()].right = node;
+        }
+
+        spine.push_back(node);
+    }
+
+    while (!spine.empty()) {
+        update(spine.back());
+        root = spine.back();
+        spine.pop_back();
+    }
+
+    if (root != NullNode) {
+        nodes[root].parent = NullNode;
+    }
+}
+
+}
@@ -0,0 +1,87 @@
+#include <tree-sitter-format/document/RangeIndex.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace tree_sitter_format {
+
+    size_t RangeIndex::firstEndingAfter(const Position& position, size_t first) const {
+        auto range = std::partition_point(ranges.begin() + first, ranges.end(), [&](const Range& r) {
+            return r.end <= position;
+        });
+
+        return size_t(range - ranges.begin());
+    }
+
+    bool RangeIndex::overlaps(const Range& range, size_t firstEndingAfterStart) const {
+        return firstEndingAfterStart < ranges.size() && ranges[firstEndingAfterStart].start < range.end;
+    }
+
+    bool RangeIndex::containsEndPointOf(const Range& range, size_t firstEndingAfterStart) const {
+        if (firstEndingAfterStart < ranges.size()) {
+            const Range& candidate = ranges[firstEndingAfterStart];
+            if (candidate.start <= range.start && candidate.start < range.end) {
+                return true;
+            }
+        }
+
+        // The end point counts as within a range that ends exactly where it does
+        size_t firstEndingAtEnd = firstEndingAfter(range.end, firstEndingAfterStart);
+        if (firstEndingAtEnd > 0 && ranges[firstEndingAtEnd - 1].end == range.end) {
+            firstEndingAtEnd--;
+        }
+
+        return firstEndingAtEnd < ranges.size() && ranges[firstEndingAtEnd].start < range.end;
+    }
+
+    bool RangeIndex::contains(const Position& position, size_t firstEndingAfterPosition) const {
+        return firstEndingAfterPosition < ranges.size() && ranges[firstEndingAfterPosition].start <= position;
+    }
+
+    void RangeIndex::push_back(const Range& range) {
+        assert(ranges.empty() || ranges.back().end <= range.start);
+        ranges.push_back(range);
+    }
+
+    bool RangeIndex::overlaps(const Range& range) const {
+        return overlaps(range, firstEndingAfter(range.start));
+    }
+
+    bool RangeIndex::containsEndPointOf(const Range& range) const {
+        return containsEndPointOf(range, firstEndingAfter(range.start));
+    }
+
+    bool RangeIndex::contains(const Position& position) const {
+        return contains(position, firstEndingAfter(position));
+    }
+
+    size_t RangeIndex::Cursor::seek(const Position& position) {
+        assert(index != nullptr);
+
+        // Everything before `next` ended at or before the last position asked about. If that
+        // isn't true of this position, it is earlier, so start again from the beginning.
+        if (next > 0 && index->ranges[next - 1].end > position) {
+            next = index->firstEndingAfter(position);
+            return next;
+        }
+
+        while (next < index->ranges.size() && index->ranges[next].end <= position) {
+            next++;
+        }
+
+        return next;
+    }
+
+    bool RangeIndex::Cursor::overlaps(const Range& range) {
+        return index->overlaps(range, seek(range.start));
+    }
+
+    bool RangeIndex::Cursor::containsEndPointOf(const Range& range) {
+        return index->containsEndPointOf(range, seek(range.start));
+    }
+
+    bool RangeIndex::Cursor::contains(const Position& position) {
+        return index->contains(position, seek(position));
+    }
+
+}
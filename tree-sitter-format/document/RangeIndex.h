@@ -0,0 +1,66 @@
+#pragma once
+
+#include <tree-sitter-format/document/Position.h>
+#include <tree-sitter-format/document/Range.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace tree_sitter_format {
+
+// A sorted list of ranges that don't overlap each other. Queries are binary searches over
+// the range ends.
+class RangeIndex {
+private:
+    std::vector<Range> ranges;
+
+    // The index of the first range that ends after `position`, searching from `first`.
+    size_t firstEndingAfter(const Position& position, size_t first = 0) const;
+
+    bool overlaps(const Range& range, size_t firstEndingAfterStart) const;
+    bool containsEndPointOf(const Range& range, size_t firstEndingAfterStart) const;
+    bool contains(const Position& position, size_t firstEndingAfterPosition) const;
+
+public:
+    // For queries made in document order, like during a traversal. Each query continues from
+    // where the previous one ended, so a whole traversal walks the ranges once instead of
+    // searching them for every query. Querying an earlier position still works, it just
+    // falls back to a binary search.
+    class Cursor {
+    private:
+        const RangeIndex* index = nullptr;
+        size_t next = 0;
+
+        size_t seek(const Position& position);
+
+    public:
+        Cursor() = default;
+        explicit Cursor(const RangeIndex& index) : index(&index) {}
+
+        bool overlaps(const Range& range);
+        bool containsEndPointOf(const Range& range);
+        bool contains(const Position& position);
+    };
+
+    void clear() { ranges.clear(); }
+    void push_back(const Range& range);
+
+    size_t size() const { return ranges.size(); }
+    bool empty() const { return ranges.empty(); }
+
+    std::vector<Range>::const_iterator begin() const { return ranges.begin(); }
+    std::vector<Range>::const_iterator end() const { return ranges.end(); }
+
+    // Returns whether any part of `range` is within one of the ranges.
+    bool overlaps(const Range& range) const;
+
+    // Returns whether either end point of `range` is within one of the ranges. This is
+    // false if `range` only contains whole ranges.
+    bool containsEndPointOf(const Range& range) const;
+
+    bool contains(const Position& position) const;
+
+    Cursor cursor() const { return Cursor(*this); }
+};
+
+}
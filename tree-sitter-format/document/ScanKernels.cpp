@@ -0,0 +1,495 @@
+#include <tree-sitter-format/document/ScanKernels.h>
+
+#include <algorithm>
+#include <bit>
+
+// SSE2 is part of x86-64, so only 32 bit x86 builds and other architectures go without it.
+// AVX2 isn't, so the AVX2 loops are compiled for it on their own and only run when the CPU
+// has it. Builds that target AVX2 anyway (-mavx2 or /arch:AVX2) don't need to check.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TSF_SCAN_SSE2
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define TSF_SCAN_AVX2
+#endif
+
+#if defined(TSF_SCAN_AVX2)
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TSF_TARGET_AVX2
+#else
+#define TSF_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(TSF_SCAN_SSE2)
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // Continuation bytes are 0x80 to 0xBF, which are the smallest values when read as signed.
+    // Every other byte is greater than 0xBF read as signed.
+    constexpr int8_t LargestContinuationByte = int8_t(0xBF);
+
+#if defined(TSF_SCAN_AVX2)
+    bool DetectAvx2() {
+#if defined(__AVX2__)
+        return true;
+#elif defined(_MSC_VER) && !defined(__clang__)
+        // The CPU has to support AVX2, and the OS has to save the upper halves of the
+        // registers, which it says with OSXSAVE and XCR0
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+
+        __cpuid(info, 1);
+        bool osSavesRegisters = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 0b110) == 0b110;
+
+        __cpuidex(info, 7, 0);
+        return osSavesRegisters && (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    bool HasAvx2() {
+        static const bool hasAvx2 = DetectAvx2();
+        return hasAvx2;
+    }
+
+    // Each of these goes through the bytes 32 at a time, and returns where the first match is,
+    // or where it stopped if there isn't one. The loops after them finish the last few bytes,
+    // and find a match right away if it stopped at one.
+    TSF_TARGET_AVX2 size_t FindLineBreakOrEscapeAvx2(const char* data, size_t size) {
+        const __m256i carriageReturns = _mm256_set1_epi8('\r');
+        const __m256i lineFeeds = _mm256_set1_epi8('\n');
+        const __m256i backslashes = _mm256_set1_epi8('\\');
+
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            __m256i matches = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(block, carriageReturns), _mm256_cmpeq_epi8(block, lineFeeds)),
+                _mm256_cmpeq_epi8(block, backslashes));
+
+            uint32_t mask = uint32_t(_mm256_movemask_epi8(matches));
+            if (mask != 0) {
+                return i + size_t(std::countr_zero(mask));
+            }
+        }
+
+        return i;
+    }
+
+    TSF_TARGET_AVX2 size_t FindNonAsciiOrLineFeedAvx2(const char* data, size_t size) {
+        const __m256i lineFeeds = _mm256_set1_epi8('\n');
+
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            __m256i matches = _mm256_or_si256(block, _mm256_cmpeq_epi8(block, lineFeeds));
+
+            uint32_t mask = uint32_t(_mm256_movemask_epi8(matches));
+            if (mask != 0) {
+                return i + size_t(std::countr_zero(mask));
+            }
+        }
+
+        return i;
+    }
+
+    // Counts the lead bytes in the whole blocks of 32 at the start of `bytes`, and returns how
+    // many bytes that was
+    TSF_TARGET_AVX2 size_t CountLeadBytesAvx2(const char* data, size_t size, uint32_t& count) {
+        const __m256i largestContinuationByte = _mm256_set1_epi8(LargestContinuationByte);
+
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            __m256i leads = _mm256_cmpgt_epi8(block, largestContinuationByte);
+
+            count += uint32_t(std::popcount(uint32_t(_mm256_movemask_epi8(leads))));
+        }
+
+        return i;
+    }
+
+    // The lookup tables from Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction
+    // Per Byte". Each error a pair of bytes can have is a bit. A byte is looked up by its high
+    // nibble and its low nibble, and the byte after it by its high nibble, and the pair has an
+    // error where all three have that bit set.
+    constexpr uint8_t TooShort = 1 << 0;     // 11______ 0_______, 11______ 11______
+    constexpr uint8_t TooLong = 1 << 1;      // 0_______ 10______
+    constexpr uint8_t Overlong3 = 1 << 2;    // 11100000 100_____
+    constexpr uint8_t TooLarge = 1 << 3;     // 11110100 1001____, 11110100 101_____, 11110101 1001____, ...
+    constexpr uint8_t Surrogate = 1 << 4;    // 11101101 101_____
+    constexpr uint8_t Overlong2 = 1 << 5;    // 1100000_ 10______
+    constexpr uint8_t TooLarge1000 = 1 << 6; // 11110101 1000____, 1111011_ 1000____, 11111___ 1000____
+    constexpr uint8_t Overlong4 = 1 << 6;    // 11110000 1000____
+    constexpr uint8_t TwoContinuations = 1 << 7; // 10______ 10______, which is fine for the third and fourth bytes
+    constexpr uint8_t Carry = TooShort | TooLong | TwoContinuations;
+
+    // Both halves of an AVX2 shuffle look up in their own copy of the table
+    TSF_TARGET_AVX2 __m256i NibbleTable(const uint8_t (&table)[16]) {
+        __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table));
+        return _mm256_broadcastsi128_si256(half);
+    }
+
+    constexpr uint8_t FirstByteHigh[16] = {
+        // 0_______
+        TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong,
+        // 10______
+        TwoContinuations, TwoContinuations, TwoContinuations, TwoContinuations,
+        // 1100____
+        TooShort | Overlong2,
+        // 1101____
+        TooShort,
+        // 1110____
+        TooShort | Overlong3 | Surrogate,
+        // 1111____
+        TooShort | TooLarge | TooLarge1000 | Overlong4,
+    };
+
+    constexpr uint8_t FirstByteLow[16] = {
+        // ____0000
+        Carry | Overlong3 | Overlong2 | Overlong4,
+        // ____0001
+        Carry | Overlong2,
+        // ____001_
+        Carry, Carry,
+        // ____0100
+        Carry | TooLarge,
+        // ____0101 to ____1100
+        Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000,
+        // ____1101
+        Carry | TooLarge | TooLarge1000 | Surrogate,
+        // ____111_
+        Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000,
+    };
+
+    constexpr uint8_t SecondByteHigh[16] = {
+        // 0_______
+        TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort,
+        // 1000____
+        TooLong | Overlong2 | TwoContinuations | Overlong3 | TooLarge1000 | Overlong4,
+        // 1001____
+        TooLong | Overlong2 | TwoContinuations | Overlong3 | TooLarge,
+        // 101_____
+        TooLong | Overlong2 | TwoContinuations | Surrogate | TooLarge,
+        TooLong | Overlong2 | TwoContinuations | Surrogate | TooLarge,
+        // 11______
+        TooShort, TooShort, TooShort, TooShort,
+    };
+
+    // Checks the whole blocks of 32 at the start of `data`, and returns how many bytes it
+    // checked before it found an error, or before the end. Every sequence that ends before
+    // that is well formed, but one may run past it, so the caller carries on from where that
+    // sequence starts, and finds the exact byte of an error itself.
+    TSF_TARGET_AVX2 size_t ValidateUtf8Avx2(const char* data, size_t size, bool& isAscii) {
+        const __m256i firstByteHigh = NibbleTable(FirstByteHigh);
+        const __m256i firstByteLow = NibbleTable(FirstByteLow);
+        const __m256i secondByteHigh = NibbleTable(SecondByteHigh);
+        const __m256i lowNibbles = _mm256_set1_epi8(0x0F);
+
+        // The bytes that must be the third or fourth of a sequence are 0x80 or more once these
+        // are taken off the bytes two and three before them, which the subtraction saturates
+        const __m256i thirdByte = _mm256_set1_epi8(char(0xE0 - 0x80));
+        const __m256i fourthByte = _mm256_set1_epi8(char(0xF0 - 0x80));
+        const __m256i topBits = _mm256_set1_epi8(char(0x80));
+
+        // The last three bytes of a block are more than zero after these are taken off if they
+        // start a sequence that needs more bytes than the block has left
+        const __m256i incompleteLimits = _mm256_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            char(0xF0 - 1), char(0xE0 - 1), char(0xC0 - 1));
+
+        __m256i previous = _mm256_setzero_si256();
+        __m256i previousIncomplete = _mm256_setzero_si256();
+
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+
+            if (_mm256_movemask_epi8(block) == 0) {
+                if (!_mm256_testz_si256(previousIncomplete, previousIncomplete)) {
+                    return i;
+                }
+
+                previous = block;
+                continue;
+            }
+
+            isAscii = false;
+
+            // Each byte with the one, two and three before it, which can be in the block before
+            __m256i carried = _mm256_permute2x128_si256(previous, block, 0x21);
+            __m256i previous1 = _mm256_alignr_epi8(block, carried, 15);
+            __m256i previous2 = _mm256_alignr_epi8(block, carried, 14);
+            __m256i previous3 = _mm256_alignr_epi8(block, carried, 13);
+
+            __m256i errors = _mm256_and_si256(
+                _mm256_and_si256(
+                    _mm256_shuffle_epi8(firstByteHigh, _mm256_and_si256(_mm256_srli_epi16(previous1, 4), lowNibbles)),
+                    _mm256_shuffle_epi8(firstByteLow, _mm256_and_si256(previous1, lowNibbles))),
+                _mm256_shuffle_epi8(secondByteHigh, _mm256_and_si256(_mm256_srli_epi16(block, 4), lowNibbles)));
+
+            // Two continuation bytes in a row are only right when the second is a third or
+            // fourth byte, and a third or fourth byte has to be a continuation byte
+            __m256i mustContinue = _mm256_and_si256(
+                _mm256_or_si256(_mm256_subs_epu8(previous2, thirdByte), _mm256_subs_epu8(previous3, fourthByte)),
+                topBits);
+            errors = _mm256_xor_si256(errors, mustContinue);
+
+            if (!_mm256_testz_si256(errors, errors)) {
+                return i;
+            }
+
+            previous = block;
+            previousIncomplete = _mm256_subs_epu8(block, incompleteLimits);
+        }
+
+        return i;
+    }
+#endif
+
+    bool IsLineBreakOrEscape(char character) {
+        return character == '\r' || character == '\n' || character == '\\';
+    }
+
+    // The length of the well formed UTF-8 sequence starting at `start`, or zero if there isn't
+    // one. See the table of well formed byte sequences in section 3.9 of the Unicode standard.
+    size_t SequenceLength(const unsigned char* start, size_t available) {
+        unsigned char lead = start[0];
+        if (lead < 0x80) {
+            return 1;
+        }
+
+        size_t length = 0;
+        unsigned char secondMin = 0x80;
+        unsigned char secondMax = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            length = 2;
+        } else if (lead >= 0xE0 && lead <= 0xEF) {
+            length = 3;
+            if (lead == 0xE0) {
+                secondMin = 0xA0;
+            } else if (lead == 0xED) {
+                secondMax = 0x9F;
+            }
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+            length = 4;
+            if (lead == 0xF0) {
+                secondMin = 0x90;
+            } else if (lead == 0xF4) {
+                secondMax = 0x8F;
+            }
+        } else {
+            return 0;
+        }
+
+        if (available < length || start[1] < secondMin || start[1] > secondMax) {
+            return 0;
+        }
+
+        for (size_t i = 2; i < length; i++) {
+            if (start[i] < 0x80 || start[i] > 0xBF) {
+                return 0;
+            }
+        }
+
+        return length;
+    }
+
+    // Whether the 16 bytes at `data` are all ASCII. Bytes that aren't have their top bit set,
+    // which is what movemask collects.
+#if defined(TSF_SCAN_SSE2)
+    constexpr size_t AsciiBlockSize = 16;
+
+    bool IsAsciiBlock(const char* data) {
+        return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data))) == 0;
+    }
+#else
+    constexpr size_t AsciiBlockSize = 8;
+
+    bool IsAsciiBlock(const char* data) {
+        for (size_t i = 0; i < AsciiBlockSize; i++) {
+            if (int8_t(data[i]) < 0) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+#endif
+}
+
+namespace tree_sitter_format {
+
+    size_t FindLineBreakOrEscape(std::string_view bytes) {
+        const char* data = bytes.data();
+        size_t size = bytes.size();
+        size_t i = 0;
+
+#if defined(TSF_SCAN_AVX2)
+        if (HasAvx2()) {
+            i = FindLineBreakOrEscapeAvx2(data, size);
+        }
+#endif
+
+#if defined(TSF_SCAN_SSE2)
+        const __m128i carriageReturns = _mm_set1_epi8('\r');
+        const __m128i lineFeeds = _mm_set1_epi8('\n');
+        const __m128i backslashes = _mm_set1_epi8('\\');
+
+        for (; i + 16 <= size; i += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i matches = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(block, carriageReturns), _mm_cmpeq_epi8(block, lineFeeds)),
+                _mm_cmpeq_epi8(block, backslashes));
+
+            uint32_t mask = uint32_t(_mm_movemask_epi8(matches));
+            if (mask != 0) {
+                return i + size_t(std::countr_zero(mask));
+            }
+        }
+#endif
+
+        for (; i < size; i++) {
+            if (IsLineBreakOrEscape(data[i])) {
+                return i;
+            }
+        }
+
+        return size;
+    }
+
+    size_t FindNonAsciiOrLineFeed(std::string_view bytes) {
+        const char* data = bytes.data();
+        size_t size = bytes.size();
+        size_t i = 0;
+
+        // The top bit of every byte that isn't ASCII is set, which is what movemask collects,
+        // so only line feeds need comparing
+#if defined(TSF_SCAN_AVX2)
+        if (HasAvx2()) {
+            i = FindNonAsciiOrLineFeedAvx2(data, size);
+        }
+#endif
+
+#if defined(TSF_SCAN_SSE2)
+        const __m128i lineFeeds = _mm_set1_epi8('\n');
+
+        for (; i + 16 <= size; i += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i matches = _mm_or_si128(block, _mm_cmpeq_epi8(block, lineFeeds));
+
+            uint32_t mask = uint32_t(_mm_movemask_epi8(matches));
+            if (mask != 0) {
+                return i + size_t(std::countr_zero(mask));
+            }
+        }
+#endif
+
+        for (; i < size; i++) {
+            if (int8_t(data[i]) < 0 || data[i] == '\n') {
+                return i;
+            }
+        }
+
+        return size;
+    }
+
+    uint32_t CountLeadBytes(std::string_view bytes) {
+        const char* data = bytes.data();
+        size_t size = bytes.size();
+        size_t i = 0;
+        uint32_t count = 0;
+
+#if defined(TSF_SCAN_AVX2)
+        if (HasAvx2()) {
+            i = CountLeadBytesAvx2(data, size, count);
+        }
+#endif
+
+#if defined(TSF_SCAN_SSE2)
+        const __m128i largestContinuationByte = _mm_set1_epi8(LargestContinuationByte);
+
+        for (; i + 16 <= size; i += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i leads = _mm_cmpgt_epi8(block, largestContinuationByte);
+
+            count += uint32_t(std::popcount(uint32_t(_mm_movemask_epi8(leads))));
+        }
+#endif
+
+        for (; i < size; i++) {
+            if (int8_t(data[i]) > LargestContinuationByte) {
+                count++;
+            }
+        }
+
+        return count;
+    }
+
+    Utf8Validation ValidateUtf8(std::string_view bytes) {
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(bytes.data());
+        size_t size = bytes.size();
+        size_t i = 0;
+
+        Utf8Validation validation;
+
+#if defined(TSF_SCAN_AVX2)
+        // Without AVX2 there's no byte shuffle to look up the tables with, since SSE2 doesn't
+        // have one, so only the blocks that are all ASCII are skipped below
+        if (HasAvx2()) {
+            size_t checked = ValidateUtf8Avx2(bytes.data(), size, validation.isAscii);
+
+            // Back up to the start of a sequence that runs past what was checked
+            i = checked;
+            while (i > 0 && checked - i < 3 && (data[i - 1] & 0xC0) == 0x80) {
+                i--;
+            }
+
+            if (i > 0 && data[i - 1] >= 0xC0) {
+                i--;
+            } else {
+                i = checked;
+            }
+        }
+#endif
+
+        while (i < size) {
+            // Source code is almost all ASCII, so whole blocks of it are skipped at once. Only
+            // blocks with something else in them are checked a sequence at a time.
+            if (i + AsciiBlockSize <= size && IsAsciiBlock(bytes.data() + i)) {
+                i += AsciiBlockSize;
+                continue;
+            }
+
+            size_t blockEnd = std::min(i + AsciiBlockSize, size);
+            while (i < blockEnd) {
+                size_t length = SequenceLength(data + i, size - i);
+                if (length == 0) {
+                    validation.firstInvalidByte = i;
+                    validation.isAscii = false;
+                    return validation;
+                }
+
+                if (length > 1) {
+                    validation.isAscii = false;
+                }
+
+                i += length;
+            }
+        }
+
+        return validation;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// Byte scanning loops that the line scanning in PieceAlgorithms and the bulk stepping in
+// UnicodeIterator spend most of their time in. On x86 they use AVX2 when the CPU has it and
+// SSE2 otherwise, and elsewhere plain loops.
+
+namespace tree_sitter_format {
+
+// The index of the first '\r', '\n' or '\\' in `bytes`, or `bytes.size()` if there isn't one
+size_t FindLineBreakOrEscape(std::string_view bytes);
+
+// The index of the first byte in `bytes` that isn't ASCII or is a '\n', or `bytes.size()` if
+// there isn't one
+size_t FindNonAsciiOrLineFeed(std::string_view bytes);
+
+// The number of bytes in `bytes` that aren't UTF-8 continuation bytes, which is the number
+// of code points that start in `bytes`. Columns are counted in bytes, but this is how wide
+// text is when it is shown.
+uint32_t CountLeadBytes(std::string_view bytes);
+
+struct Utf8Validation {
+    // The offset of the first byte that isn't part of a well formed UTF-8 sequence, if any.
+    // Overlong encodings, surrogates and code points past U+10FFFF aren't well formed.
+    std::optional<size_t> firstInvalidByte;
+
+    // Whether every byte is ASCII, in which case every byte is a code point of its own
+    bool isAscii = true;
+};
+
+// With AVX2, blocks that aren't all ASCII are checked 32 bytes at a time too. Otherwise only
+// the blocks that are all ASCII are skipped, and the rest are checked a sequence at a time.
+Utf8Validation ValidateUtf8(std::string_view bytes);
+
+}
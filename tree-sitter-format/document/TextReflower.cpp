@@ -1,6 +1,7 @@
 #include <tree-sitter-format/document/TextReflower.h>
 
 #include <tree-sitter-format/Util.h>
+#include <tree-sitter-format/document/ScanKernels.h>
 
 #include <array>
 
@@ -24,6 +25,17 @@ namespace {
         return true;
     }
 
+    // How many columns `slice` takes up when shown. Positions count bytes, but each code point
+    // is shown in one column.
+    [[nodiscard]] uint32_t Width(const DocumentSlice& slice) {
+        uint32_t width = 0;
+        slice.visitContents([&](std::string_view element) {
+            width += CountLeadBytes(element);
+        });
+
+        return width;
+    }
+
     [[nodiscard]] bool StartsWithWhitespace(const DocumentSlice& line) {
         return line.startsWith("   "sv) || line.startsWith("  \t") || line.startsWith(" \t") || line.startsWith("\t");
     }
@@ -89,9 +101,7 @@ namespace {
         UnicodeIterator end = line.end();
 
         while(character != end) {
-            while(character != end && IsWhitespace(*character)) {
-                character++;
-            }
+            character.advanceWhile(IsWhitespace);
 
             if (character == end) {
                 // We only have whitespace left on the line, so no more words
@@ -100,13 +110,10 @@ namespace {
 
             // byte count is not the same as column count, so we have to keep
             // track of it separately.
-            uint32_t length = 0;
             UnicodeIterator start = character;
-
-            while(character != end && !IsWhitespace(*character)) {
-                character++;
-                length++;
-            }
+            uint32_t length = character.advanceWhile([](char32_t codePoint) {
+                return !IsWhitespace(codePoint);
+            });
 
             words.push_back(Word{
                 .elements = UnicodeIterator::ElementsBetween(start, character),
@@ -120,7 +127,7 @@ namespace {
 
 namespace tree_sitter_format {
 
-    LineInfo::LineInfo(const DocumentSlice& line) {
+    LineInfo::LineInfo(const DocumentSlice& line, uint32_t startColumn) {
         DocumentSlice trimmed = line.trimFront();
 
         isEmpty = trimmed.range().byteCount() == 0;
@@ -129,16 +136,16 @@ namespace tree_sitter_format {
         startsWithSpecialPrefix = StartsWithSpecialPrefix(line);
         listItemInfo = GetListItemInfo(trimmed);
         initialWhitespace = Range::Between(line.startPosition(), trimmed.startPosition());
-        endColumn = line.endPosition().location.column;
+        endColumn = startColumn + Width(line);
     }
 
 
-    TextReflower::TextReflower(uint32_t startingLineLength, uint32_t targetLineLength)
-     : linePrefix(" * "sv), newLineIndent(0), targetLineLength(targetLineLength)
+    TextReflower::TextReflower(AddBuffer& text, uint32_t startingLineLength, uint32_t targetLineLength)
+     : text(text), linePrefix(" * "sv), newLineIndent(0), targetLineLength(targetLineLength)
      , currentLineLength(0), currentWordCount(0), startingLineLength(startingLineLength) {
         // The first line always starts with a space right after the opening comment token.
         // The line prefix is only added to subsequent lines.
-        currentLine.push_back(GetSpaces(1));
+        currentLine.push_back(" "sv);
         currentLineLength = startingLineLength + 1;
     }
 
@@ -164,17 +171,19 @@ namespace tree_sitter_format {
     }
 
     void TextReflower::addWhitespace(const DocumentSlice& whitespace) {
-        auto& contents = whitespace.contents();
-        currentLine.insert(currentLine.end(), contents.begin(), contents.end());
-        currentLineLength += whitespace.range().end.location.column - whitespace.range().start.location.column;
+        whitespace.visitContents([&](std::string_view element) {
+            currentLine.push_back(element);
+        });
+        currentLineLength += Width(whitespace);
         // Since this is just white space (we take the caller's word for it), we don't increment the word count
         // because we want it to be trimmed if we start a new line without adding anything more.
     }
 
     void TextReflower::addLineAsIs(const DocumentSlice& line) {
-        auto& contents = line.contents();
-        currentLine.insert(currentLine.end(), contents.begin(), contents.end());
-        currentLineLength += line.range().end.location.column - line.range().start.location.column;
+        line.visitContents([&](std::string_view element) {
+            currentLine.push_back(element);
+        });
+        currentLineLength += Width(line);
 
         // Add a space to the line
         currentLine.push_back(" "sv);
@@ -219,7 +228,7 @@ namespace tree_sitter_format {
         currentLineLength += uint32_t(linePrefix.size());
 
         if (newLineIndent > 0) {
-            currentLine.push_back(GetSpaces(newLineIndent));
+            currentLine.push_back(text.appendRepeated(' ', newLineIndent));
             currentLineLength += newLineIndent;
         }
 
@@ -245,7 +254,7 @@ namespace tree_sitter_format {
                 currentLineLength = startingLineLength;
             }
 
-            currentLine.push_back(GetSpaces(newIndentation));
+            currentLine.push_back(text.appendRepeated(' ', newIndentation));
             currentLineLength += newIndentation;
         }
 
@@ -258,13 +267,14 @@ namespace tree_sitter_format {
         startNewLineIfNotEmpty();
 
         // Add the number
-        auto& number = info.number.contents();
-        currentLine.insert(currentLine.end(), number.begin(), number.end());
+        info.number.visitContents([&](std::string_view element) {
+            currentLine.push_back(element);
+        });
         currentLineLength += info.columnCount;
         currentWordCount++;
 
         // Add a space after the number
-        currentLine.push_back(GetSpaces(1));
+        currentLine.push_back(" "sv);
         currentLineLength++;
 
         // subsequent lines are indented more, this is + 1 because we
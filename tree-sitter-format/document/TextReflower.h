@@ -1,5 +1,6 @@
 #pragma once
 
+#include <tree-sitter-format/document/AddBuffer.h>
 #include <tree-sitter-format/document/DocumentSlice.h>
 
 #include <optional>
@@ -21,12 +22,18 @@ namespace tree_sitter_format {
         bool startsWithSpecialPrefix;
         std::optional<ListItemInfo> listItemInfo;
         Range initialWhitespace;
+
+        // The column the line ends at when shown, counting code points, not bytes
         uint32_t endColumn;
 
-        explicit LineInfo(const DocumentSlice& line);
+        // `startColumn` is the column the line starts at when shown
+        LineInfo(const DocumentSlice& line, uint32_t startColumn);
     };
 
     struct TextReflower {
+        // Holds the indentation added to lines, so it must outlive the lines
+        AddBuffer& text;
+
         std::string_view linePrefix;
 
         // this is in addition to the line prefix length
@@ -41,7 +48,7 @@ namespace tree_sitter_format {
         uint32_t currentWordCount;
         uint32_t startingLineLength;
 
-        TextReflower(uint32_t startingLineLength, uint32_t targetLineLength);
+        TextReflower(AddBuffer& text, uint32_t startingLineLength, uint32_t targetLineLength);
 
         void addWords(const DocumentSlice& line);
         void addWhitespace(const DocumentSlice& whitespace);
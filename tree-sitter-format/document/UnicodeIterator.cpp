@@ -1,84 +1,77 @@
 #include <tree-sitter-format/document/UnicodeIterator.h>
 
-namespace tree_sitter_format {
+#include <tree-sitter-format/document/PieceAlgorithms.h>
+#include <tree-sitter-format/document/ScanKernels.h>
 
-    bool Location::operator==(const Location& other) const {
-        return index == other.index && offset == other.offset;
+namespace {
+    constexpr char8_t UTF8ContinuationMask = 0b11000000;
+    constexpr char8_t UTF8ContinuationValue = 0b10000000;
+
+    bool IsContinuation(char8_t byte) {
+        return (byte & UTF8ContinuationMask) == UTF8ContinuationValue;
     }
 
-    std::weak_ordering Location::operator<=>(const Location& other) const {
-        if (index == other.index) {
-            return offset <=> other.offset;
-        } else {
-            return index <=> other.index;
+    // The number of continuation bytes a sequence starting with `lead` should have, and the
+    // bits of the code point that `lead` holds. A byte that can't start a sequence is taken as
+    // a code point of its own, so malformed text still moves forward.
+    struct LeadByte {
+        size_t continuationBytes;
+        char32_t value;
+    };
+
+    LeadByte DecodeLead(char8_t lead) {
+        if ((lead & 0b11100000) == 0b11000000) {
+            return LeadByte { .continuationBytes = 1, .value = char32_t(lead & 0b00011111) };
+        } else if ((lead & 0b11110000) == 0b11100000) {
+            return LeadByte { .continuationBytes = 2, .value = char32_t(lead & 0b00001111) };
+        } else if ((lead & 0b11111000) == 0b11110000) {
+            return LeadByte { .continuationBytes = 3, .value = char32_t(lead & 0b00000111) };
         }
-    }
 
-    UnicodeIterator::UnicodeIterator(const std::vector<std::string_view>& elements) : elements(elements), currentValue(0) {
-        assert(!elements.empty());
+        return LeadByte { .continuationBytes = 0, .value = lead };
+    }
+}
 
-        current = Location {
-            .index = 0,
-            .offset = 0,
-            .position = Position {
-                .location = TSPoint {
-                    .row = 0,
-                    .column = 0,
-                },
-                .byteOffset = 0,
-            },
-        };
+namespace tree_sitter_format {
 
-        next = current;
+    bool Location::operator==(const Location& other) const {
+        return position.byteOffset == other.position.byteOffset;
+    }
 
-        uint32_t totalBytes = 0;
-        for(std::string_view element : elements) {
-            totalBytes += uint32_t(element.size());
-        }
+    std::weak_ordering Location::operator<=>(const Location& other) const {
+        return position.byteOffset <=> other.position.byteOffset;
+    }
 
-        // We don't know the end location, but thats ok. It is never used for anything,
-        // so it doesn't matter what we initialize it to. We do know the other, necessary
-        // information though.
-        end = Location {
-            .index = elements.size() - 1,
-            .offset = elements.back().size(),
-            .position = Position {
-                .location = TSPoint {
-                    .row = 0,
-                    .column = 0,
-                },
-                .byteOffset = totalBytes,
-            },
-        };
-
-        (*this)++;
-    }
-
-    UnicodeIterator::UnicodeIterator(const std::vector<std::string_view>& elements, const Range& range) : elements(elements), currentValue(0) {
-        assert(!elements.empty());
-
-        current = Location {
-            .index = 0,
-            .offset = 0,
-            .position = range.start,
-        };
+    UnicodeIterator::UnicodeIterator(const PieceTree::Location& start, const Range& range)
+        : current {.piece = start.piece, .offset = start.offset, .position = range.start}
+        , next(current)
+        , rangeStart(range.start)
+        , endByte(range.end.byteOffset)
+        , currentValue(0) {
+        assert(range.start.byteOffset <= range.end.byteOffset);
 
-        next = current;
+        // Decode the first code point, so the iterator starts by dereferencing to it
+        ++(*this);
+    }
 
-        end = Location {
-            .index = elements.size() - 1,
-            .offset = elements.back().size(),
-            .position = range.end,
-        };
+    UnicodeIterator UnicodeIterator::EndOf(const PieceTree::Location& end, const Range& range) {
+        UnicodeIterator iterator(end, Range::Between(range.end, range.end));
+        iterator.rangeStart = range.start;
 
-        (*this)++;
+        return iterator;
     }
 
-    UnicodeIterator::UnicodeIterator(const std::vector<std::string_view>& elements, const Location& start, const Location& end)
-        : elements(elements), current(start), next(start), end(std::move(end)), currentValue(0) {
-        assert(!elements.empty());
+    char8_t UnicodeIterator::readByte() {
+        assert(next.position.byteOffset < endByte);
+
+        // Pieces are never empty, and there are bytes left, so this stops at a real piece
+        while (next.offset == next.piece->size()) {
+            ++next.piece;
+            next.offset = 0;
+        }
 
-        (*this)++;
+        next.position.byteOffset++;
+        return char8_t((*next.piece)[next.offset++]);
     }
 
     UnicodeIterator UnicodeIterator::operator++(int) {
@@ -89,94 +82,207 @@ namespace tree_sitter_format {
     }
 
     UnicodeIterator& UnicodeIterator::operator++() {
-        static constexpr char8_t UTF8ContinuationMask = 0b11000000;
-        static constexpr char8_t UTF8ContinuationValue = 0b10000000;
-
         // If we are at the end, do nothing
-        if (current == end) {
+        if (atEnd()) {
             return *this;
         }
 
         current = next;
-        char32_t newValue = 0;
+        if (atEnd()) {
+            return *this;
+        }
 
-        uint32_t byteCount = 0;
+        char8_t leadByte = readByte();
 
-        for(; next.index <= end.index; next.index++) {
-            size_t maxOffset = elements[next.index].size();
-            if (next.index == end.index) {
-                maxOffset = end.offset;
+        // Most text is ASCII, which doesn't need decoding
+        LeadByte lead = leadByte < 0x80 ? LeadByte { .continuationBytes = 0, .value = leadByte } : DecodeLead(leadByte);
+
+        char32_t newValue = lead.value;
+        for (size_t continuationBytes = lead.continuationBytes; continuationBytes > 0 && next.position.byteOffset < endByte; continuationBytes--) {
+            // Peek before reading, so a truncated sequence doesn't swallow the next code point
+            Location peek = next;
+            char8_t character = readByte();
+            if (!IsContinuation(character)) {
+                next = peek;
+                break;
             }
 
-            for(size_t offset = next.offset; offset < maxOffset; next.offset++) {
-                char32_t character = elements[next.index][next.offset];
+            newValue = (newValue << 6) | (character & 0b00111111);
+        }
+
+        // Columns are in bytes, like tree-sitter's
+        if (currentValue != '\\' && newValue == '\n') {
+            next.position.location.row++;
+            next.position.location.column = 0;
+        } else {
+            next.position.location.column += next.position.byteOffset - current.position.byteOffset;
+        }
 
-                char masked = character & UTF8ContinuationMask;
-                bool isContinuation = masked == UTF8ContinuationValue;
+        currentValue = newValue;
+        return *this;
+    }
 
-                newValue |= character << 24;
-                newValue >>= 8;
-                byteCount++;
+    std::string_view UnicodeIterator::asciiRun() const {
+        if (atEnd()) {
+            return std::string_view();
+        }
 
-                // we shouldn't have more than 3 continuation bytes, otherwise the
-                // character doesn't fit in 32 bits which shouldn't be possible.
-                assert(byteCount < 4 || !isContinuation);
+        Location start = AtByte(current);
+        std::string_view rest = std::string_view(*start.piece).substr(start.offset, endByte - current.position.byteOffset);
+        return rest.substr(0, FindNonAsciiOrLineFeed(rest));
+    }
 
-                if (!isContinuation) {
-                    next.offset++;
+    void UnicodeIterator::advanceAscii(size_t count) {
+        assert(count > 0 && count <= asciiRun().size());
 
-                    newValue >>= 8 * (3 - byteCount);
+        // None of the skipped code points are new lines, so only the column changes. `next` is
+        // put just past them, so incrementing moves onto the code point after them.
+        Location start = AtByte(current);
+        uint32_t skipped = uint32_t(count - 1);
 
-                    if (currentValue != '\\' && newValue == '\n') {
-                        next.position.location.row++;
-                        next.position.location.column = 0;
-                    } else {
-                        next.position.location.column++;
-                    }
+        currentValue = char8_t((*start.piece)[start.offset + skipped]);
+        next = start;
+        next.offset += count;
+        next.position.byteOffset += uint32_t(count);
+        next.position.location.column += uint32_t(count);
 
-                    next.position.byteOffset += byteCount;
+        ++(*this);
+    }
 
-                    currentValue = newValue;
-                    return *this;
-                }
-            }
+    Location UnicodeIterator::AtByte(Location location) {
+        // Pieces are never empty, so this stops at a real piece as long as there are bytes left
+        while (location.offset == location.piece->size()) {
+            ++location.piece;
+            location.offset = 0;
         }
-        // If we reach here, its because we just iterated to the end, which means the start should
-        // equal the end, which is one past the end of the last character in the last element.
-        assert(current == end);
 
-        return *this;
+        return location;
     }
 
-    bool UnicodeIterator::operator==(const UnicodeIterator& other) const {
-        return (&elements == &other.elements) && ((*this <=> other) == std::strong_ordering::equal);
+    char8_t UnicodeIterator::ReadByteBefore(Location& location) {
+        // Pieces are never empty, so this stops at a real piece. It also steps back from the
+        // end iterator, which is where a location at the end of the tree points.
+        while (location.offset == 0) {
+            --location.piece;
+            location.offset = location.piece->size();
+        }
+
+        location.position.byteOffset--;
+        return char8_t((*location.piece)[--location.offset]);
     }
 
-    bool UnicodeIterator::operator!=(const UnicodeIterator& other) const {
-        return (&elements != &other.elements) || !(*this == other);
+    Position UnicodeIterator::positionOf(const Location& location, uint32_t row) const {
+        // Walk back to the start of the line, which is just after a new line that isn't escaped
+        Location lineStart = location;
+        while (lineStart.position.byteOffset > rangeStart.byteOffset) {
+            Location before = lineStart;
+            if (ReadByteBefore(before) == '\n') {
+                Location escape = before;
+                bool escaped = before.position.byteOffset > rangeStart.byteOffset && ReadByteBefore(escape) == '\\';
+                if (!escaped) {
+                    break;
+                }
+            }
+
+            lineStart = before;
+        }
+
+        // Columns are in bytes, so the column is how far `location` is from the start of the line
+        Position position = location.position;
+        if (lineStart.position.byteOffset > rangeStart.byteOffset) {
+            position.location = TSPoint {
+                .row = row,
+                .column = location.position.byteOffset - lineStart.position.byteOffset,
+            };
+        } else {
+            position.location = TSPoint {
+                .row = rangeStart.location.row,
+                .column = rangeStart.location.column + (location.position.byteOffset - rangeStart.byteOffset),
+            };
+        }
+
+        return position;
     }
 
-    std::strong_ordering UnicodeIterator::operator<=>(const UnicodeIterator& other) const {
-        // Both iterators should be pointing at the same elements
-        assert(&elements == &other.elements);
+    UnicodeIterator UnicodeIterator::operator--(int) {
+        UnicodeIterator original = *this;
+        --(*this);
+
+        return original;
+    }
 
-        if (current.index < other.current.index) {
-            return std::strong_ordering::less;
+    UnicodeIterator& UnicodeIterator::operator--() {
+        // If we are at the start, do nothing
+        if (atStart()) {
+            return *this;
         }
 
-        if (current.index > other.current.index) {
-            return std::strong_ordering::greater;
+        Location previous = current;
+        char8_t last = ReadByteBefore(previous);
+        char32_t newValue = last;
+
+        // Walk back over the continuation bytes to find the lead byte. If the lead byte's sequence
+        // is at least as long as what was found, incrementing would have decoded it all as one code
+        // point, even if it was truncated. Otherwise the last byte is a code point of its own.
+        if (IsContinuation(last)) {
+            Location lead = previous;
+            char32_t value = last & 0b00111111;
+            size_t continuationBytes = 1;
+
+            while (lead.position.byteOffset > rangeStart.byteOffset) {
+                char8_t candidate = ReadByteBefore(lead);
+                if (IsContinuation(candidate)) {
+                    if (continuationBytes == 3) {
+                        break;
+                    }
+
+                    value |= char32_t(candidate & 0b00111111) << (6 * continuationBytes);
+                    continuationBytes++;
+                    continue;
+                }
+
+                LeadByte decoded = DecodeLead(candidate);
+                if (decoded.continuationBytes >= continuationBytes) {
+                    previous = lead;
+                    newValue = (decoded.value << (6 * continuationBytes)) | value;
+                }
+
+                break;
+            }
         }
 
-        if (current.offset < other.current.offset) {
-            return std::strong_ordering::less;
+        next = current;
+        current = previous;
+        currentValue = newValue;
+
+        // Stepping back over a code point on the same line only takes its bytes off the column.
+        // Stepping back over a new line means finding where the previous line started.
+        bool wasNewLine = newValue == '\n';
+        if (wasNewLine && current.position.byteOffset > rangeStart.byteOffset) {
+            Location escape = current;
+            wasNewLine = ReadByteBefore(escape) != '\\';
         }
 
-        if (current.offset > other.current.offset) {
-            return std::strong_ordering::greater;
+        if (wasNewLine) {
+            current.position = positionOf(current, next.position.location.row - 1);
+        } else {
+            current.position.location = next.position.location;
+            current.position.location.column -= next.position.byteOffset - current.position.byteOffset;
         }
 
-        return std::strong_ordering::equal;
+        return *this;
+    }
+
+    bool UnicodeIterator::operator==(const UnicodeIterator& other) const {
+        return current == other.current;
+    }
+
+    bool UnicodeIterator::operator!=(const UnicodeIterator& other) const {
+        return !(*this == other);
+    }
+
+    std::strong_ordering UnicodeIterator::operator<=>(const UnicodeIterator& other) const {
+        return current.position.byteOffset <=> other.current.position.byteOffset;
     }
 
     std::vector<std::string_view> UnicodeIterator::ElementsBetween(const UnicodeIterator& start, const UnicodeIterator& end) {
@@ -184,25 +290,14 @@ namespace tree_sitter_format {
         assert(start <= end);
 
         std::vector<std::string_view> elements;
-        for(size_t index = start.current.index; index <= end.current.index; index++) {
-            std::string_view element = start.elements[index];
 
-            // Remove the end first, otherwise the element would have a different length than
-            // when the offset was recorded, making it invalid.
-            if (index == end.current.index) {
-                element.remove_suffix(element.size() - end.current.offset);
-            }
-
-            if (index == start.current.index) {
-                element.remove_prefix(start.current.offset);
-            }
-
-            // We may have a zero size element if we are given the same iterators, or when the end
-            // iterator is the start of an element. In that case we don't wan't to record it.
-            if (element.size() > 0) {
+        uint32_t byteCount = end.current.position.byteOffset - start.current.position.byteOffset;
+        VisitPieces(start.current.piece, start.current.offset, byteCount, [&](std::string_view element) {
+            // The start may be at the very end of a piece, which gives an empty element
+            if (!element.empty()) {
                 elements.push_back(element);
             }
-        }
+        });
 
         return elements;
     }
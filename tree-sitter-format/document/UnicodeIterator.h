@@ -1,8 +1,10 @@
 #pragma once
 
+#include <tree-sitter-format/document/PieceTree.h>
 #include <tree-sitter-format/document/Position.h>
 #include <tree-sitter-format/document/Range.h>
 
+#include <algorithm>
 #include <cassert>
 #include <compare>
 #include <iterator>
@@ -11,46 +13,78 @@
 
 namespace tree_sitter_format {
     struct Location {
-        size_t index;
+        PieceTree::const_iterator piece;
         size_t offset;
 
         Position position;
 
-        // Note: these are comparing the location within a vector of
-        //       elements, NOT the position
+        // Note: these compare byte offsets, so they are only meaningful for locations
+        //       within the same pieces
         bool operator==(const Location& other) const;
         std::weak_ordering operator<=>(const Location& other) const;
     };
 
+    // Iterates over the code points of a range of a piece tree, in either direction. It refers
+    // to the tree's pieces rather than copying them, so it is only valid until the tree is modified.
+    // Positions have their columns in bytes, like tree-sitter's and the document's.
     class UnicodeIterator {
     private:
-        const std::vector<std::string_view>& elements;
-
         Location current;
         Location next;
-        Location end;
+        Position rangeStart;
+        uint32_t endByte;
 
         char32_t currentValue;
 
+        // Reads the byte at `next` and moves past it
+        char8_t readByte();
+
+        // `location`, moved onto the start of the next piece if it is at the end of one, so
+        // it points at the byte there rather than past its piece
+        static Location AtByte(Location location);
+
+        // Moves `location` back one byte and reads the byte there. Only the byte offset of its
+        // position is kept up to date.
+        static char8_t ReadByteBefore(Location& location);
+
+        // The position of `location`, which is on row `row`. The column is found by walking back
+        // to the start of the row, and is the number of bytes from there.
+        Position positionOf(const Location& location, uint32_t row) const;
+
     public:
-        explicit UnicodeIterator(const std::vector<std::string_view>& elements);
-        UnicodeIterator(const std::vector<std::string_view>& elements, const Range& range);
-        UnicodeIterator(const std::vector<std::string_view>& elements, const Location& start, const Location& end);
+        // Starts at the first code point of `range`, which is `start.offset` bytes into `start.piece`
+        UnicodeIterator(const PieceTree::Location& start, const Range& range);
 
-        // Don't allow temporary element vectors since we only store a reference to them. This object doesn't own the elements
-        // just iterates over them.
-        explicit UnicodeIterator(const std::vector<std::string_view>&& elements) = delete;
-        UnicodeIterator(const std::vector<std::string_view>&& elements, const Range& range) = delete;
-        UnicodeIterator(const std::vector<std::string_view>&& elements, const Location& start, const Location& end) = delete;
+        // Starts at the end of `range`, which is `end.offset` bytes into `end.piece`, so that
+        // decrementing it gives the last code point of `range`
+        static UnicodeIterator EndOf(const PieceTree::Location& end, const Range& range);
 
         UnicodeIterator(const UnicodeIterator& other) = default;
+        UnicodeIterator& operator=(const UnicodeIterator& other) = default;
 
         const Position& currentPosition() const { return current.position; }
-        bool atEnd() const { return current == end; }
+        bool atStart() const { return current.position.byteOffset == rangeStart.byteOffset; }
+        bool atEnd() const { return current.position.byteOffset == endByte; }
 
         UnicodeIterator operator++(int);
         UnicodeIterator& operator++();
 
+        UnicodeIterator operator--(int);
+        UnicodeIterator& operator--();
+
+        // The code points from the current one up to the first one that isn't ASCII or is a new
+        // line, stopping at the end of the current piece or the range. Each byte is one code point.
+        // Empty if the current code point isn't ASCII or is a new line.
+        std::string_view asciiRun() const;
+
+        // Moves forward over the first `count` code points of `asciiRun()`
+        void advanceAscii(size_t count);
+
+        // Moves forward while `predicate` holds for the current code point, stepping over runs of
+        // ASCII in bulk. Returns how many code points were moved over.
+        template<typename PREDICATE>
+        uint32_t advanceWhile(PREDICATE&& predicate);
+
         bool operator==(const UnicodeIterator& other) const;
         bool operator!=(const UnicodeIterator& other) const;
 
@@ -60,4 +94,38 @@ namespace tree_sitter_format {
 
         static std::vector<std::string_view> ElementsBetween(const UnicodeIterator& start, const UnicodeIterator& end);
     };
+
+    template<typename PREDICATE>
+    uint32_t UnicodeIterator::advanceWhile(PREDICATE&& predicate) {
+        uint32_t count = 0;
+
+        while (!atEnd()) {
+            std::string_view run = asciiRun();
+            if (run.empty()) {
+                if (!predicate(currentValue)) {
+                    break;
+                }
+
+                ++(*this);
+                count++;
+                continue;
+            }
+
+            auto firstFailing = std::find_if_not(run.begin(), run.end(), [&](char character) {
+                return predicate(char32_t(character));
+            });
+
+            size_t matching = size_t(firstFailing - run.begin());
+            if (matching > 0) {
+                advanceAscii(matching);
+                count += uint32_t(matching);
+            }
+
+            if (matching < run.size()) {
+                break;
+            }
+        }
+
+        return count;
+    }
 }
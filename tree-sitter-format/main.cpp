@@ -1,6 +1,7 @@
 #include <tree-sitter-format/Constants.h>
 #include <tree-sitter-format/style/Style.h>
 #include <tree-sitter-format/document/Document.h>
+#include <tree-sitter-format/document/DocumentWriter.h>
 
 #include <tree-sitter-format/traversers/BracketExistanceTraverser.h>
 #include <tree-sitter-format/traversers/IndentationTraverser.h>
@@ -74,6 +75,11 @@ int main() {
     style.indentation.reindent = false;
 
     Document document(inputFileName);
+    if (!document.isValidUtf8()) {
+        std::cerr << "The file isn't valid UTF-8 at byte " << document.firstInvalidByte().value() << ". Skipping formatting." << std::endl;
+        return EXIT_FAILURE;
+    }
+
     std::cout << "Input Text: " << std::endl << std::endl;
 
     TSNode root = document.root();
@@ -85,12 +91,6 @@ int main() {
     }
 
 
-    std::ofstream output(outputFileName, std::ofstream::out | std::ofstream::trunc);
-    if (!output) {
-        std::cerr << "FAIL" << std::endl;
-        return EXIT_FAILURE;
-    }
-
     Formatter formatter;
     // Ensure Braces
     formatter.addTraverser(std::make_unique<BracketExistanceTraverser>());
@@ -98,8 +98,9 @@ int main() {
     formatter.addTraverser(std::make_unique<IndentationTraverser>());
     // Debug Print
     //formatter.addTraverser(std::make_unique<ParseTraverser>());
-    // Trailing Space
-    formatter.addTraverser(std::make_unique<SpaceTraverser>());
+    // Trailing Space. Spacing within lines doesn't depend on their indentation, so this shares
+    // the indentation pass.
+    formatter.addTraverser(std::make_unique<SpaceTraverser>(), PassOrdering::WithPrevious);
     // Alignment
     formatter.addTraverser(std::make_unique<DeclarationAlignmentTraverser>());
     formatter.addTraverser(std::make_unique<BitfieldAlignmentTraverser>());
@@ -108,12 +109,31 @@ int main() {
     formatter.addTraverser(std::make_unique<CommentAlignmentTraverser>());
     formatter.addTraverser(std::make_unique<MultilineCommentReflowTraverser>());
 
-    formatter.format(style, document);
+    // Indentation and spacing walk the tree on separate threads
+    ThreadPool pool;
+    formatter.setThreadPool(&pool);
+
+    document.collectParseStatistics();
+    FormatResult result = formatter.format(style, document);
+    if (result != FormatResult::Formatted) {
+        switch (result) {
+            case FormatResult::TimedOut: std::cerr << "Formatting timed out"; break;
+            case FormatResult::Cancelled: std::cerr << "Formatting was cancelled"; break;
+            case FormatResult::InvalidUtf8: std::cerr << "The file isn't valid UTF-8"; break;
+            default: std::cerr << "The file couldn't be parsed"; break;
+        }
+
+        std::cerr << ", leaving the file unchanged." << std::endl;
+        return EXIT_FAILURE;
+    }
 
-    output << document;
+    const ParseStatistics& statistics = document.parseStatistics().value();
+    std::cout << "Reparsed " << statistics.reparses << " times, reusing " << statistics.reusedNodes << " of " << statistics.nodes << " nodes, and moved the tree without reparsing " << statistics.shifts << " times" << std::endl;
 
-    output.flush();
-    output.close();
+    if (!WriteDocument(outputFileName, document)) {
+        std::cerr << "FAIL" << std::endl;
+        return EXIT_FAILURE;
+    }
 
 
     return EXIT_SUCCESS;
@@ -6,19 +6,6 @@
 
 namespace {
     using namespace tree_sitter_format;
-    std::string CreateIndentationString(const Style& style) {
-        char c = style.indentation.whitespace == Style::IndentationWhitespace::Tabs ? '\t' : ' ';
-        return std::string(style.indentation.indentationAmount, c);
-    }
-
-    std::string CreateNewLineString(const Style& style) {
-        switch (style.spacing.newLineType) {
-            case Style::NewLineType::CRLF: return "\r\n";
-            case Style::NewLineType::LF: return "\n";
-            case Style::NewLineType::CR: return "\r";
-            default: return "\n";
-        }
-    }
 
     YAML::Node GetMap(YAML::Node node, const std::string& name) {
         YAML::Node map = node[name];
@@ -417,13 +404,17 @@ namespace {
 }
 
 namespace tree_sitter_format {
-    std::string_view Style::indentationString() const {
-        static std::string s = CreateIndentationString(*this);
-        return s;
+    char Style::indentationCharacter() const {
+        return indentation.whitespace == IndentationWhitespace::Tabs ? '\t' : ' ';
     }
+
     std::string_view Style::newLineString() const {
-        static std::string s = CreateNewLineString(*this);
-        return s;
+        switch (spacing.newLineType) {
+            case NewLineType::CRLF: return "\r\n";
+            case NewLineType::LF: return "\n";
+            case NewLineType::CR: return "\r";
+            default: return "\n";
+        }
     }
 
     Style Style::FromClangFormat(const std::string& config) {
@@ -37,7 +37,7 @@ struct Style {
         bool reindent = true;
     } indentation;
 
-    std::string_view indentationString() const;
+    char indentationCharacter() const;
 
     enum class BraceExistance { Require, Remove, Ignore };
 
@@ -28,7 +28,7 @@ namespace {
             }
 
             uint32_t spaceToAdd = maxColumn - startColumn;
-            context.edits.push_back(InsertEdit{.position = Position::StartOf(node), .bytes = GetSpaces(spaceToAdd)});
+            context.edits.push_back(InsertEdit{.position = Position::StartOf(node), .bytes = context.text.appendRepeated(' ', spaceToAdd)});
         }
     }
 
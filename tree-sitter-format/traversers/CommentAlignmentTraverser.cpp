@@ -26,7 +26,7 @@ namespace {
                 // Otherwise, remove all space between the previous node and the current node
                 context.edits.push_back(DeleteEdit {.range = Range::Between(previousPosition, currentPosition)});
                 // And insert a single space so that the trailing comment is "left justified" against the end of the line
-                context.edits.push_back(InsertEdit {.position = previousPosition, .bytes = GetSpaces(1)});
+                context.edits.push_back(InsertEdit {.position = previousPosition, .bytes = " "});
             } else if (currentPosition.location.column != 0) {
                 // If we are the only thing on the line, remove all preceeding whitespace
                 Range preceedingWhitespace = context.document.toPreviousNewLine(currentPosition);
@@ -59,7 +59,7 @@ namespace {
             context.edits.push_back(DeleteEdit{.range = range});
 
             uint32_t columnsToAdd = maxColumn - range.start.location.column;
-            context.edits.push_back(InsertEdit{.position = ranges[i].start, .bytes = GetSpaces(columnsToAdd)});
+            context.edits.push_back(InsertEdit{.position = ranges[i].start, .bytes = context.text.appendRepeated(' ', columnsToAdd)});
         }
     }
 
@@ -268,7 +268,7 @@ namespace tree_sitter_format {
 
 void IndentationTraverser::reset(const TraverserContext& context) {
     scope = 0;
-    previousPosition = Position::StartOf(context.document.root());
+    previousPosition = Position::StartOf(context.root);
 }
 
 void IndentationTraverser::visitLeaf(TSNode node, TraverserContext& context) {
@@ -283,14 +283,16 @@ void IndentationTraverser::visitLeaf(TSNode node, TraverserContext& context) {
 
     // We only want to modify things if this is the first node on a line, and only if it doesn't
     // start within an unformattable range.
-    if (previousRow != currentRow && !context.document.isWithinAnUnformattableRange(position)) {
+    if (previousRow != currentRow && !context.unformattableRanges.contains(position)) {
         Range preceedingWhitespace = context.document.toPreviousNewLine(position);
 
         // Delete the previous white space
         context.edits.push_back(DeleteEdit{.range = preceedingWhitespace});
 
-        for(uint32_t i = 0; i < scope; i++) {
-            context.edits.push_back(InsertEdit{.position = preceedingWhitespace.start, .bytes = context.style.indentationString()});
+        uint32_t indentation = scope * context.style.indentation.indentationAmount;
+        if (indentation > 0) {
+            std::string_view bytes = context.text.appendRepeated(context.style.indentationCharacter(), indentation);
+            context.edits.push_back(InsertEdit{.position = preceedingWhitespace.start, .bytes = bytes});
         }
     }
 
@@ -306,9 +308,19 @@ void IndentationTraverser::preVisitChild(TSNode node, uint32_t childIndex, Trave
 
 void IndentationTraverser::postVisitChild(TSNode node, uint32_t childIndex, TraverserContext& context) {
     ScopeChange change = ScopeChangeForChild(node, childIndex, context.style);
-    if (change == ScopeChange::DecreaseAfter || change == ScopeChange::Both) {
+    if ((change == ScopeChange::DecreaseAfter || change == ScopeChange::Both) && scope > 0) {
         scope--;
     }
 }
 
+void IndentationTraverser::skipChild(TSNode node, uint32_t childIndex, TraverserContext& context) {
+    // A skipped child still opens or closes its scope, or the children after it that are
+    // formatted would be indented as if it were never there.
+    preVisitChild(node, childIndex, context);
+    postVisitChild(node, childIndex, context);
+
+    // Nothing in it is visited, so the next leaf compares its row with the child's last one
+    previousPosition = Position::EndOf(ts_node_child(node, childIndex));
+}
+
 }
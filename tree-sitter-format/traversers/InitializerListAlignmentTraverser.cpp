@@ -84,13 +84,13 @@ namespace {
                 e.spaceAdded -= toPreviousNode.byteCount();
 
                 context.edits.push_back(DeleteEdit{.range = toPreviousNode});
-                context.edits.push_back(InsertEdit{.position = toPreviousNode.start, .bytes = GetSpaces(spaceToAdd)});
+                context.edits.push_back(InsertEdit{.position = toPreviousNode.start, .bytes = context.text.appendRepeated(' ', spaceToAdd)});
             } else {
                 Range toNextNode = ToStartOfNextNode(endNode);
                 e.spaceAdded -= toNextNode.byteCount();
 
                 context.edits.push_back(DeleteEdit{.range = toNextNode});
-                context.edits.push_back(InsertEdit{.position = toNextNode.start, .bytes = GetSpaces(spaceToAdd)});
+                context.edits.push_back(InsertEdit{.position = toNextNode.start, .bytes = context.text.appendRepeated(' ', spaceToAdd)});
             }
         }
     }
@@ -125,7 +125,7 @@ namespace {
             uint32_t spaceAdded = iterators[i].spaceAdded;
 
             uint32_t spaceToAdd = newEndColumn - (originalEnd + spaceAdded);
-            context.edits.push_back(InsertEdit{.position = Position::StartOf(endBracket), .bytes = GetSpaces(spaceToAdd)});
+            context.edits.push_back(InsertEdit{.position = Position::StartOf(endBracket), .bytes = context.text.appendRepeated(' ', spaceToAdd)});
         }
     }
 
@@ -5,6 +5,7 @@
 #include <tree-sitter-format/document/Document.h>
 #include <tree-sitter-format/document/TextReflower.h>
 
+#include <algorithm>
 #include <array>
 #include <assert.h>
 #include <unordered_map>
@@ -55,16 +56,10 @@ namespace {
 
         // If all the lines start with the same prefix, remove the prefix!
         if (allSame) {
-            std::vector<std::string_view> prefixVector = {prefix};
-            UnicodeIterator prefixIterator(prefixVector);
-            while(!prefixIterator.atEnd()) {
-                prefixIterator++;
-            }
-
             for(size_t i = 1; allSame && i < lastLineToCheck; i++) {
                 Position newStart = lines[i].startPosition();
-                newStart.location.column += prefixIterator.currentPosition().location.column;
-                newStart.byteOffset += prefixIterator.currentPosition().byteOffset;
+                newStart.location.column += uint32_t(prefix.size());
+                newStart.byteOffset += uint32_t(prefix.size());
 
                 Range trimmedRange {
                     .start = newStart,
@@ -168,11 +163,14 @@ namespace {
     }
 
     std::vector<std::vector<std::string_view>> ReflowLines(std::vector<DocumentSlice>& lines, uint32_t firstLineOffset, TraverserContext& context) {
-        TextReflower comment(firstLineOffset, context.style.targetLineLength);
+        TextReflower comment(context.text, firstLineOffset, context.style.targetLineLength);
         std::optional<ListItemInfo> currentListItem;
 
         for(const DocumentSlice& line : lines) {
-            LineInfo info(line);
+            // The first line starts right after the "/*". The others start at the start of their
+            // line, or after the prefix, which is ASCII, so their columns are already how they are shown.
+            uint32_t startColumn = &line == &lines.front() ? firstLineOffset - 1 : line.startPosition().location.column;
+            LineInfo info(line, startColumn);
 
             // If this line starts a list item
             if (info.listItemInfo.has_value()) {
@@ -290,7 +288,7 @@ namespace {
         // The first line starts 3 characters after the start of the comment. IE is starts after "/* " which will be
         // the enforced start of the comment after reflow.
         Position start = Position::StartOf(node);
-        uint32_t firstLineOffset = start.location.column + 3;
+        uint32_t firstLineOffset = context.document.displayColumn(start) + 3;
 
         std::vector<std::vector<std::string_view>> reflowedLines = ReflowLines(lines, firstLineOffset, context);
 
@@ -19,7 +19,7 @@ namespace {
         const Position rhs = Position::StartOf(nextNode);
 
         // If the edit would be within an unformattable range, skip it
-        if (context.document.overlapsUnformattableRange(Range::Between(lhs, rhs))) {
+        if (context.unformattableRanges.overlaps(Range::Between(lhs, rhs))) {
             return;
         }
 
@@ -174,7 +174,7 @@ namespace {
 namespace tree_sitter_format {
 
 void SpaceTraverser::reset(const TraverserContext& context) {
-    previousPosition = Position::StartOf(context.document.root());
+    previousPosition = Position::StartOf(context.root);
 }
 
 void SpaceTraverser::visitLeaf(TSNode node, TraverserContext& context) {
@@ -186,7 +186,9 @@ void SpaceTraverser::visitLeaf(TSNode node, TraverserContext& context) {
 
     if (currentPosition.location.row > previousPosition.location.row) {
         Range trailingSpace = context.document.toNextNewLine(previousPosition);
-        context.edits.push_back(DeleteEdit{ .range = trailingSpace });
+        if (trailingSpace.byteCount() > 0) {
+            context.edits.push_back(DeleteEdit{ .range = trailingSpace });
+        }
     }
 
     previousPosition = Position::EndOf(node);
@@ -207,4 +209,10 @@ void SpaceTraverser::preVisitChild(TSNode node, uint32_t childIndex, TraverserCo
     }
 }
 
+void SpaceTraverser::skipChild(TSNode node, uint32_t childIndex, TraverserContext&) {
+    // Trailing space is trimmed from the end of the child's last line, not from wherever the
+    // last visited leaf ended
+    previousPosition = Position::EndOf(ts_node_child(node, childIndex));
+}
+
 }
@@ -12,5 +12,6 @@ protected:
 
     void visitLeaf(TSNode node, TraverserContext& context) override;
     void preVisitChild(TSNode node, uint32_t childIndex, TraverserContext& context) override;
+    void skipChild(TSNode node, uint32_t childIndex, TraverserContext& context) override;
 };
 }
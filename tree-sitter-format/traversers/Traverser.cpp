@@ -1,5 +1,61 @@
 #include <tree-sitter-format/traversers/Traverser.h>
 
+#include <algorithm>
+
+namespace {
+    using namespace tree_sitter_format;
+
+    // Touching counts, so the tokens right before and after a range are still visited.
+    // Traversers compare each token with the one before it.
+    bool Intersects(std::span<const Range> ranges, TSNode node) {
+        if (ranges.empty()) {
+            return true;
+        }
+
+        auto range = std::ranges::lower_bound(ranges, ts_node_start_byte(node), {}, [](const Range& r) { return r.end.byteOffset; });
+        return range != ranges.end() && range->start.byteOffset <= ts_node_end_byte(node);
+    }
+
+    bool IsPastRanges(std::span<const Range> ranges, TSNode node) {
+        return !ranges.empty() && ts_node_start_byte(node) > ranges.back().end.byteOffset;
+    }
+
+    // Moves to the first child that could intersect the ranges, skipping the ones before it
+    // without visiting them, and returns its index. Without ranges, that's the first child.
+    int64_t GotoFirstChild(TSTreeCursor* cursor, std::span<const Range> ranges) {
+        if (ranges.empty()) {
+            return ts_tree_cursor_goto_first_child(cursor) ? 0 : -1;
+        }
+
+        // This finds the first child that ends after the byte, so a child that ends right
+        // where the first range starts, which touches it, is found by asking for the byte
+        // before that.
+        uint32_t start = ranges.front().start.byteOffset;
+        return ts_tree_cursor_goto_first_child_for_byte(cursor, start > 0 ? start - 1 : 0);
+    }
+
+    constexpr uint32_t LEAVES_PER_CHECK = 1024;
+
+    // Counts a leaf, and every LEAVES_PER_CHECK leaves checks whether the walk should stop
+    bool ShouldStop(TraverserContext& context) {
+        if (context.leavesUntilCheck > 0) {
+            context.leavesUntilCheck--;
+            return context.stopped;
+        }
+
+        context.leavesUntilCheck = LEAVES_PER_CHECK - 1;
+        context.stopped = (context.cancellationFlag != nullptr && context.cancellationFlag->load() != 0) ||
+            std::chrono::steady_clock::now() >= context.deadline;
+        return context.stopped;
+    }
+
+    // The children before the one GotoFirstChild moved to, which were skipped. If it didn't
+    // find one, every child was.
+    uint32_t FirstVisitedChild(TSNode node, int64_t firstChild) {
+        return firstChild < 0 ? ts_node_child_count(node) : uint32_t(firstChild);
+    }
+}
+
 namespace tree_sitter_format {
 
 void Traverser::reset(const TraverserContext&) { };
@@ -7,20 +63,22 @@ void Traverser::reset(const TraverserContext&) { };
 void Traverser::visitLeaf(TSNode, TraverserContext&) { };
 void Traverser::preVisitChild(TSNode, uint32_t, TraverserContext&) { };
 void Traverser::postVisitChild(TSNode, uint32_t, TraverserContext&) { };
+void Traverser::skipChild(TSNode, uint32_t, TraverserContext&) { };
 
-std::vector<Edit> Traverser::traverse(const Document& document, const Style& style) {
-    TraverserContext context {
-        .document = document,
-        .style = style,
-    };
+void Traverser::traverse(TraverserContext& context) {
+    traverse(context.document.root(), context);
+}
 
+void Traverser::traverse(TSNode root, TraverserContext& context) {
+    context.root = root;
+    context.unformattableRanges = context.document.unformattableRangeCursor();
+    context.stopped = false;
+    context.leavesUntilCheck = 0;
     reset(context);
 
-    TSTreeCursor cursor = ts_tree_cursor_new(document.root());
+    TSTreeCursor cursor = ts_tree_cursor_new(root);
     traverse(&cursor, context);
     ts_tree_cursor_delete(&cursor);
-
-    return std::move(context.edits);
 }
 
 void Traverser::traverse(TSTreeCursor* cursor, TraverserContext& context) {
@@ -29,19 +87,122 @@ void Traverser::traverse(TSTreeCursor* cursor, TraverserContext& context) {
         return;
     }
 
-    if (ts_tree_cursor_goto_first_child(cursor)) {
-        uint32_t childIndex = 0;
-        do {
+    if (ts_node_child_count(node) == 0) {
+        if (!ShouldStop(context)) {
+            visitLeaf(node, context);
+        }
+        return;
+    }
+
+    int64_t firstChild = GotoFirstChild(cursor, context.ranges);
+    for (uint32_t skipped = 0; skipped < FirstVisitedChild(node, firstChild); skipped++) {
+        skipChild(node, skipped, context);
+    }
+
+    if (firstChild < 0) {
+        return;
+    }
+
+    uint32_t childIndex = uint32_t(firstChild);
+    do {
+        TSNode child = ts_tree_cursor_current_node(cursor);
+        if (context.stopped || IsPastRanges(context.ranges, child)) {
+            break;
+        }
+
+        if (Intersects(context.ranges, child)) {
             preVisitChild(node, childIndex, context);
             traverse(cursor, context);
             postVisitChild(node, childIndex, context);
+        } else {
+            skipChild(node, childIndex, context);
+        }
+
+        childIndex++;
+    } while (ts_tree_cursor_goto_next_sibling(cursor));
 
-            childIndex++;
-        } while (ts_tree_cursor_goto_next_sibling(cursor));
-        assert(ts_tree_cursor_goto_parent(cursor));
-    } else {
-        visitLeaf(node, context);
+    [[maybe_unused]] bool wentToParent = ts_tree_cursor_goto_parent(cursor);
+    assert(wentToParent);
+}
+
+void Traverser::TraverseAll(std::span<Traverser* const> traversers, std::span<TraverserContext> contexts) {
+    assert(!traversers.empty() && traversers.size() == contexts.size());
+
+    for (size_t i = 0; i < traversers.size(); i++) {
+        contexts[i].root = contexts[i].document.root();
+        contexts[i].unformattableRanges = contexts[i].document.unformattableRangeCursor();
+        contexts[i].stopped = false;
+        contexts[i].leavesUntilCheck = 0;
+        traversers[i]->reset(contexts[i]);
+    }
+
+    TSTreeCursor cursor = ts_tree_cursor_new(contexts.front().document.root());
+    TraverseAll(&cursor, traversers, contexts);
+    ts_tree_cursor_delete(&cursor);
+
+    // Only the first context's limits are checked, since the traversers walk together
+    for (TraverserContext& context : contexts) {
+        context.stopped = contexts.front().stopped;
+    }
+}
+
+void Traverser::TraverseAll(TSTreeCursor* cursor, std::span<Traverser* const> traversers, std::span<TraverserContext> contexts) {
+    TSNode node = ts_tree_cursor_current_node(cursor);
+    if (ts_node_is_null(node)) {
+        return;
+    }
+
+    if (ts_node_child_count(node) == 0) {
+        if (!ShouldStop(contexts.front())) {
+            for (size_t i = 0; i < traversers.size(); i++) {
+                traversers[i]->visitLeaf(node, contexts[i]);
+            }
+        }
+        return;
+    }
+
+    // The traversers walk together, so they share the ranges they are restricted to
+    std::span<const Range> ranges = contexts.front().ranges;
+
+    int64_t firstChild = GotoFirstChild(cursor, ranges);
+    for (uint32_t skipped = 0; skipped < FirstVisitedChild(node, firstChild); skipped++) {
+        for (size_t i = 0; i < traversers.size(); i++) {
+            traversers[i]->skipChild(node, skipped, contexts[i]);
+        }
+    }
+
+    if (firstChild < 0) {
+        return;
     }
+
+    uint32_t childIndex = uint32_t(firstChild);
+    do {
+        TSNode child = ts_tree_cursor_current_node(cursor);
+        if (contexts.front().stopped || IsPastRanges(ranges, child)) {
+            break;
+        }
+
+        if (Intersects(ranges, child)) {
+            for (size_t i = 0; i < traversers.size(); i++) {
+                traversers[i]->preVisitChild(node, childIndex, contexts[i]);
+            }
+
+            TraverseAll(cursor, traversers, contexts);
+
+            for (size_t i = 0; i < traversers.size(); i++) {
+                traversers[i]->postVisitChild(node, childIndex, contexts[i]);
+            }
+        } else {
+            for (size_t i = 0; i < traversers.size(); i++) {
+                traversers[i]->skipChild(node, childIndex, contexts[i]);
+            }
+        }
+
+        childIndex++;
+    } while (ts_tree_cursor_goto_next_sibling(cursor));
+
+    [[maybe_unused]] bool wentToParent = ts_tree_cursor_goto_parent(cursor);
+    assert(wentToParent);
 }
 
 }
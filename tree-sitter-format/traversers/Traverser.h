@@ -1,9 +1,13 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <span>
 #include <vector>
 
 #include <tree_sitter/api.h>
 
+#include <tree-sitter-format/document/AddBuffer.h>
 #include <tree-sitter-format/document/Edits.h>
 #include <tree-sitter-format/document/Document.h>
 #include <tree-sitter-format/style/Style.h>
@@ -15,6 +19,33 @@ struct TraverserContext {
     const Style& style;
     
     std::vector<Edit> edits;
+
+    // Scratch space for the text of inserted edits. It must outlive the edits until
+    // they are applied to the document. The formatter hands it to the document along with
+    // the edits, so text appended here is kept without being copied again.
+    AddBuffer text;
+
+    // For checking the document's unformattable ranges in traversal order
+    RangeIndex::Cursor unformattableRanges;
+
+    // When only part of the document is being formatted, the ranges to format, sorted and
+    // not touching each other. Subtrees that don't touch them aren't walked. Empty means the
+    // whole document.
+    std::span<const Range> ranges;
+
+    // The root of the tree being walked. Traversers walking at the same time on different
+    // threads each walk their own copy of the document's tree, so this is used rather than
+    // the document's root.
+    TSNode root {};
+
+    // The walk stops part way once the deadline has passed or `*cancellationFlag` becomes
+    // non-zero, and sets `stopped`. Its edits are then incomplete, so they shouldn't be
+    // applied. Checking the clock costs more than visiting a leaf, so they are only checked
+    // every so many leaves.
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    const std::atomic_size_t* cancellationFlag = nullptr;
+    bool stopped = false;
+    uint32_t leavesUntilCheck = 0;
 };
 
 class Traverser {
@@ -25,11 +56,24 @@ protected:
     virtual void preVisitChild(TSNode node, uint32_t childIndex, TraverserContext& context);
     virtual void postVisitChild(TSNode node, uint32_t childIndex, TraverserContext& context);
 
+    // Called instead of the three above for a child that is outside the ranges being
+    // formatted, so it isn't walked. Traversers that carry state from one node to the next,
+    // like the scope or the last token seen, update it here as if the child had been walked.
+    virtual void skipChild(TSNode node, uint32_t childIndex, TraverserContext& context);
+
+    static void TraverseAll(TSTreeCursor* cursor, std::span<Traverser* const> traversers, std::span<TraverserContext> contexts);
+
 public:
     virtual ~Traverser() = default;
 
-    std::vector<Edit> traverse(const Document& document, const Style& style);
+    void traverse(TraverserContext& context);
+    void traverse(TSNode root, TraverserContext& context);
     void traverse(TSTreeCursor* node, TraverserContext& context);
+
+    // Walks the tree once for all of `traversers`, each with the context at the same index.
+    // Each traverser is called in the same order, with the same nodes, as if it had walked
+    // the tree on its own.
+    static void TraverseAll(std::span<Traverser* const> traversers, std::span<TraverserContext> contexts);
 };
 
 }